@@ -6,17 +6,48 @@
  *  Author: Henning Paul <hnch@gmx.net>
  */
 
+#include <linux/clk.h>
+#include <linux/cpumask.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
 #include <linux/device.h>
 #include <linux/err.h>
+#include <linux/gpio/consumer.h>
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
 #include <linux/module.h>
 #include <linux/kernel.h>
+#include <linux/kref.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/pm.h>
+#include <linux/pm_runtime.h>
+#include <linux/poll.h>
+#include <linux/property.h>
+#include <linux/sched.h>
+#include <linux/seqlock.h>
 #include <linux/spi/spi.h>
 #include <linux/slab.h>
 #include <linux/sysfs.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 #include <asm/unaligned.h>
+#include <uapi/linux/sched/types.h>
 
+#include <linux/iio/buffer.h>
+#include <linux/iio/consumer.h>
+#include <linux/iio/events.h>
 #include <linux/iio/iio.h>
 #include <linux/iio/sysfs.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
+
+#include "ltc5599.h"
 
 // 0x00
 #define LTC5599_FREQ_REG 0x00
@@ -51,40 +82,301 @@
 
 //0x06
 #define LTC5599_LOMATCH_OVR_REG 0x06
+#define LTC5599_LOMATCH_DEFAULT 0x50
 
 //0x07
 #define LTC5599_TEMPCORR_OVR_REG 0x07
+#define LTC5599_TEMPCORR_OVR_MASK 0xFF
 
 //0x08
 #define LTC5599_MODE_REG 0x08
 #define LTC5599_RESET_BIT (1<<3)
 
+#define LTC5599_NUM_REGS 9
+/* LO frequency bands selected by LTC5599_FREQ_REG, control words 1..121 */
+#define LTC5599_NUM_BANDS 121
+/* registers that affect both channels */
+#define LTC5599_SHARED_REGS (GENMASK(LTC5599_NUM_REGS - 1, 0) & \
+	~(BIT(LTC5599_OFFSI_REG) | BIT(LTC5599_OFFSQ_REG)))
+
+#define LTC5599_ADDR(addr) (((addr) & 0x7F) << 1)
 #define LTC5599_READ_OPERATION 0x01
 
+/* settling time between the software reset and the register restore */
+#define LTC5599_RESET_DELAY_US 1
+
+/* the register scrubber never runs more often than this */
+#define LTC5599_SCRUB_MIN_INTERVAL_MS 10
+/* interval is doubled up to this many times while the device is busy */
+#define LTC5599_SCRUB_MAX_BACKOFF 4
+
+/* board temperature poll period while the temperature is moving */
+#define LTC5599_TEMP_POLL_MS 1000
+/* the period is doubled up to this many times while it is stable */
+#define LTC5599_TEMP_MAX_BACKOFF 5
+/* default temperature change in milli degrees C that triggers a correction */
+#define LTC5599_TEMP_THRESHOLD 2000
+/* maximum number of entries of adi,temp-corr-table */
+#define LTC5599_TEMP_CORR_MAX 16
+
+/*
+ * SPI clock auto-tuning exercises the offset and IQ registers: the chip
+ * has no scratch register, these are the widest run without band, gain or
+ * mode side effects, and they are restored after the test.
+ */
+#define LTC5599_SPI_TUNE_FIRST LTC5599_OFFSI_REG
+#define LTC5599_SPI_TUNE_LEN 4
+#define LTC5599_SPI_TUNE_PASSES 4
+
+/* rewrites of registers that did not read back as written */
+#define LTC5599_VERIFY_RETRIES 2
+
+/* entries of the change log, a power of two */
+#define LTC5599_LOG_ENTRIES 1024
+
+/* idle time before the chip is powered down through its enable pin */
+#define LTC5599_AUTOSUSPEND_MS 1000
+/* time from raising the enable pin until the SPI port is usable */
+#define LTC5599_ENABLE_DELAY_US 10
+
+/**
+ * struct ltc5599_temp_corr - temperature correction override table entry
+ * @temp:		lowest temperature in milli degrees C the entry applies to
+ * @code:		LTC5599_TEMPCORR_OVR_REG value
+ */
+struct ltc5599_temp_corr {
+	s32	temp;
+	u8	code;
+};
+
 /**
  * struct ltc5599_chip_info - chip specific information
  * @channels:		Channel specification
+ * @num_channels:	number of channels
  */
 struct ltc5599_chip_info {
 	const struct iio_chan_spec *channels;
+	unsigned int num_channels;
+};
+
+/* scan elements of the output buffer, in sample order */
+enum ltc5599_scan {
+	LTC5599_SCAN_OFFSET_I,
+	LTC5599_SCAN_OFFSET_Q,
+	LTC5599_SCAN_HARDWAREGAIN,
+	LTC5599_SCAN_QUADRATURE_CORRECTION,
+	LTC5599_SCAN_PHASE,
+	LTC5599_SCAN_NUM,
+};
+
+/**
+ * struct ltc5599_gang - LTC5599 devices that are configured together
+ * @node:		entry in ltc5599_gangs
+ * @id:			value of the adi,gang-id property shared by the members
+ * @lock:		serialises gang commits, nests the members' mlock
+ * @members:		struct ltc5599 instances, linked through gang_node
+ * @count:		number of members
+ * @skew_ns:		time from the first to the last chip of the last commit
+ */
+struct ltc5599_gang {
+	struct list_head	node;
+	u32			id;
+	struct mutex		lock;
+	struct list_head	members;
+	unsigned int		count;
+	s64			skew_ns;
+};
+
+#define LTC5599_CAL_OFFSET	BIT(0)
+#define LTC5599_CAL_IQ		BIT(1)
+#define LTC5599_CAL_LO_MATCH	BIT(2)
+
+/* coordinate descent starts with this step and halves it down to 1 */
+#define LTC5599_CAL_START_STEP	32
+#define LTC5599_CAL_MAX_ITER	256
+/* successive parabolic search over gain ratio and phase */
+#define LTC5599_CAL_IQ_START_STEP	16
+
+/* largest per-band output level deviation the flatness table accepts */
+#define LTC5599_FLATNESS_MAX_MDB	20000
+/* attenuation range of LTC5599_GAIN_REG in dB */
+#define LTC5599_GAIN_MAX_ATTEN		19
+
+/**
+ * struct ltc5599_band_cal - calibration store entry of one LO band
+ * @valid:		LTC5599_CAL_* flags of the fields that are set
+ * @offset:		I and Q DC offset nulling the LO leakage
+ * @gain_ratio:		I/Q gain ratio code maximising image rejection
+ * @phase:		I/Q phase balance code maximising image rejection
+ * @lo_match:		LO-match override value
+ * @flatness_mdb:	output level at 0 dB attenuation relative to nominal
+ */
+struct ltc5599_band_cal {
+	u8	valid;
+	s8	offset[2];
+	s8	gain_ratio;
+	s16	phase;
+	u8	lo_match;
+	s16	flatness_mdb;
 };
 
 /**
  * struct ltc5599 - driver instance specific data
  * @spi:		the SPI device for this driver instance
+ * @indio_dev:		the IIO device for this driver instance
  * @chip_info:		chip model specific constants, available modes etc
+ * @worker:		runs the ring, the scrubber, the temperature poll and,
+ *			with @rt_priority set, triggered samples
+ * @rt_priority:	SCHED_FIFO priority of @worker, 0 for SCHED_NORMAL
+ * @trig_work:		plays out a triggered sample on @worker
+ * @trig_dropped:	triggered samples dropped because mlock was busy
+ * @scrub_work:		periodic check of the chip registers against the cache
+ * @scrub_interval_ms:	scrubber period, 0 if the scrubber is disabled
+ * @scrub_backoff:	current backoff exponent of the scrubber
+ * @scrub_recoveries:	number of times the scrubber had to restore the chip
+ * @generation:		incremented on every configuration change
+ * @seq:		lets readers copy the shadow registers without the lock
+ * @lo_clk:		optional LO clock the band setting follows
+ * @lo_nb:		rate change notifier of the LO clock
+ * @lo_event:		clock notifier event on which the band is retuned
+ * @gang:		gang this device belongs to, if any
+ * @gang_node:		entry in the gang's member list
+ * @gang_regs:		register image of the pending gang commit
+ * @gang_changed:	registers changed by the pending gang commit
+ * @gang_len:		length of the pending gang burst
+ * @gang_ret:		result of the pending gang burst
+ * @gang_done:		completion time of the pending gang burst
+ * @gang_verify:	read back the pending gang burst
+ * @verify_writes:	read back every commit in the same message
+ * @verify_failures:	number of commit read backs that did not match
+ * @miscdev:		optional character device with the batch ioctls
+ * @removed:		set under mlock once the device is gone; no commit is
+ *			made after that
+ * @ring:		mmap()able command and completion ring of the chardev
+ * @ring_ref:		held by the device and by every open chardev file
+ * @ring_work:		consumes the command ring on @worker
+ * @ring_timer:		requeues @ring_work at the deadline of the next command
+ * @ring_cq_wq:		woken up when completions are posted
+ * @ring_tail:		next command the consumer will read
+ * @ring_batch:		completions of the commands in the current burst
+ * @leakage_chan:	optional power detector measuring the LO leakage
+ * @leakage_iter:	measurements taken by the last leakage calibration
+ * @leakage_power:	power detector reading after the last calibration
+ * @image_chan:	optional power detector measuring the image sideband
+ * @image_iter:		measurements taken by the last image calibration
+ * @image_power:	power detector reading after the last image calibration
+ * @image_gain:		detector reading improvement of the last image calibration
+ * @cal:		calibration store, indexed by band control word
+ * @lo_match_bands:	number of bands with an LO-match override
+ * @lo_match_active:	LTC5599_LOMATCH_OVR_REG was last encoded with an override
+ * @level_en:		constant output level mode, gain follows the band
+ * @target_level_mdb:	output level to hold in constant output level mode
+ * @temp_chan:		optional board temperature sensor
+ * @temp_work:		temperature poll, fires a correction on large changes
+ * @temp_threshold:	temperature change in milli degrees C to correct for
+ * @temp_backoff:	current backoff exponent of the temperature poll
+ * @temp_last:		temperature of the last correction
+ * @temp_valid:		@temp_last holds a measurement
+ * @temp_stale:		set by runtime resume to force the next correction
+ * @temp_corr:		temperature correction override table, ascending
+ * @num_temp_corr:	entries in @temp_corr, 0 to pulse TEMPUPDT instead
+ * @temp_pulses:	number of TEMPUPDT pulses sent
+ * @temp_overrides:	number of temperature correction overrides written
+ * @spi_tune_bursts:	test bursts run by the SPI clock auto-tuning
+ * @spi_tune_errors:	bit errors seen by the SPI clock auto-tuning
+ * @enable_gpio:	optional enable pin, runtime PM powers the chip down with it
+ * @resume_ns:		duration of the last runtime resume
+ * @resume_max_ns:	longest runtime resume so far
+ * @log:		change log, LTC5599_LOG_ENTRIES entries
+ * @log_head:		sequence number of the next change log entry
+ * @log_overflow:	change log entries overwritten before they were read
+ * @freq_avail:		band mid frequencies in Hz, ascending
+ * @sample:		output buffer sample being played out
+ * @shadowregs:		cached register image, restored after a chip reset
  * @data:		spi transfer buffers
+ * @cmd:		spi transfer buffer for the software reset command
+ * @vtx:		spi transfer buffer for the read back of a commit
+ * @rx:			spi receive buffer for burst reads
  */
 struct ltc5599 {
 	struct spi_device		*spi;
+	struct iio_dev			*indio_dev;
 	const struct ltc5599_chip_info	*chip_info;
+	struct kthread_worker		*worker;
+	unsigned int			rt_priority;
+	struct kthread_work		trig_work;
+	unsigned int			trig_dropped;
+	struct kthread_delayed_work	scrub_work;
+	unsigned int			scrub_interval_ms;
+	unsigned int			scrub_backoff;
+	unsigned int			scrub_recoveries;
+	atomic_t			generation;
+	seqcount_mutex_t		seq;
+	struct clk			*lo_clk;
+	struct notifier_block		lo_nb;
+	unsigned long			lo_event;
+	struct ltc5599_gang		*gang;
+	struct list_head		gang_node;
+	u8				gang_regs[LTC5599_NUM_REGS];
+	unsigned long			gang_changed;
+	unsigned int			gang_len;
+	int				gang_ret;
+	ktime_t				gang_done;
+	bool				gang_verify;
+	bool				verify_writes;
+	unsigned int			verify_failures;
+	struct miscdevice		miscdev;
+	bool				removed;
+	void				*ring;
+	struct kref			ring_ref;
+	struct kthread_work		ring_work;
+	struct hrtimer			ring_timer;
+	wait_queue_head_t		ring_cq_wq;
+	u32				ring_tail;
+	struct ltc5599_completion	*ring_batch;
+	struct iio_channel		*leakage_chan;
+	unsigned int			leakage_iter;
+	int				leakage_power;
+	struct iio_channel		*image_chan;
+	unsigned int			image_iter;
+	int				image_power;
+	int				image_gain;
+	struct ltc5599_band_cal		cal[LTC5599_NUM_BANDS + 1];
+	unsigned int			lo_match_bands;
+	bool				lo_match_active;
+	bool				level_en;
+	int				target_level_mdb;
+	struct iio_channel		*temp_chan;
+	struct kthread_delayed_work	temp_work;
+	int				temp_threshold;
+	unsigned int			temp_backoff;
+	int				temp_last;
+	bool				temp_valid;
+	bool				temp_stale;
+	struct ltc5599_temp_corr	temp_corr[LTC5599_TEMP_CORR_MAX];
+	unsigned int			num_temp_corr;
+	unsigned int			temp_pulses;
+	unsigned int			temp_overrides;
+	unsigned int			spi_tune_bursts;
+	unsigned int			spi_tune_errors;
+	struct gpio_desc		*enable_gpio;
+	u64				resume_ns;
+	u64				resume_max_ns;
+	struct ltc5599_change		*log;
+	u32				log_head;
+	atomic_t			log_overflow;
+	int				freq_avail[LTC5599_NUM_BANDS];
+	s16				sample[LTC5599_SCAN_NUM] __aligned(8);
+	__u8 shadowregs[32];
 
 	/*
 	 * DMA (thus cache coherency maintenance) requires the
 	 * transfer buffers to live in their own cache lines.
 	 */
-	__u8 data[2] ____cacheline_aligned;
-	__u8 shadowregs[32];
+	__u8 data[LTC5599_NUM_REGS + 1] ____cacheline_aligned;
+	__u8 cmd[2];
+	__u8 vtx[LTC5599_NUM_REGS + 1];
+	__u8 rx[LTC5599_NUM_REGS + 1] ____cacheline_aligned;
 };
 
 enum ltc5599_type {
@@ -114,18 +406,51 @@ static int spi_read_while_write(struct spi_device *spi, const void *txbuf, void
 	return status;
 }
 
-static int ltc5599_write(struct iio_dev *indio_dev, u8 addr,	u8 val)
+/*
+ * Without an enable pin the chip is always powered and runtime PM is not
+ * used. With one, every bus access holds a runtime PM reference; it must
+ * be taken before st->data is filled, as resuming restores the chip
+ * through the same buffers.
+ */
+static int ltc5599_pm_get(struct ltc5599 *st)
+{
+	if (!st->enable_gpio)
+		return 0;
+
+	return pm_runtime_resume_and_get(&st->spi->dev);
+}
+
+static void ltc5599_pm_put(struct ltc5599 *st)
 {
-	struct ltc5599 *st = iio_priv(indio_dev);
-	int ret;
+	if (!st->enable_gpio)
+		return;
 
-	mutex_lock(&indio_dev->mlock);
-	st->data[0] = ((addr & 0x7F) << 1) & (~LTC5599_READ_OPERATION);
-	st->data[1] = val & 0xFF;
-	ret = spi_read_while_write(st->spi, st->data, NULL, 2);
-	mutex_unlock(&indio_dev->mlock);
+	pm_runtime_mark_last_busy(&st->spi->dev);
+	pm_runtime_put_autosuspend(&st->spi->dev);
+}
 
-	return ret;
+/*
+ * For background work: take a reference only if the chip is powered
+ * anyway, and never push its autosuspend out. Returns true with a
+ * reference to drop through ltc5599_pm_put_idle().
+ */
+static bool ltc5599_pm_get_if_active(struct ltc5599 *st)
+{
+	if (!st->enable_gpio)
+		return true;
+
+	return pm_runtime_get_if_active(&st->spi->dev) > 0;
+}
+
+static void ltc5599_pm_put_idle(struct ltc5599 *st)
+{
+	if (st->enable_gpio)
+		pm_runtime_put_autosuspend(&st->spi->dev);
+}
+
+static bool ltc5599_pm_suspended(struct ltc5599 *st)
+{
+	return st->enable_gpio && pm_runtime_suspended(&st->spi->dev);
 }
 
 static int ltc5599_read(struct iio_dev *indio_dev, u8 addr, u8 *val)
@@ -135,9 +460,14 @@ static int ltc5599_read(struct iio_dev *indio_dev, u8 addr, u8 *val)
 	u8 tmp[2];
 
 	mutex_lock(&indio_dev->mlock);
-	st->data[0] = ((addr & 0x7F) << 1) | LTC5599_READ_OPERATION;
+	ret = ltc5599_pm_get(st);
+	if (ret)
+		goto out_unlock;
+
+	st->data[0] = LTC5599_ADDR(addr) | LTC5599_READ_OPERATION;
 	st->data[1] = 0xFF;
 	ret = spi_read_while_write(st->spi, st->data, tmp, 2);
+	ltc5599_pm_put(st);
 	if (ret < 0)
 		goto out_unlock;
 
@@ -148,571 +478,3379 @@ out_unlock:
 	return ret;
 }
 
-static int ltc5599_write_freq(struct iio_dev *indio_dev, unsigned int val)
+/* bits that keep their value after being written, the rest clear by themselves */
+static const u8 ltc5599_persistent_mask[LTC5599_NUM_REGS] = {
+	[LTC5599_FREQ_REG]		= 0xFF,
+	[LTC5599_GAIN_REG]		= (u8)~LTC5599_TEMPUPDT_BIT,
+	[LTC5599_OFFSI_REG]		= 0xFF,
+	[LTC5599_OFFSQ_REG]		= 0xFF,
+	[LTC5599_IQ_GAINRAT_REG]	= 0xFF,
+	[LTC5599_IQ_PHASEBAL_REG]	= 0xFF,
+	[LTC5599_LOMATCH_OVR_REG]	= 0xFF,
+	[LTC5599_TEMPCORR_OVR_REG]	= 0xFF,
+	[LTC5599_MODE_REG]		= (u8)~LTC5599_RESET_BIT,
+};
+
+/*
+ * Tell observers that the configuration changed: bump the generation
+ * counter, push an IIO change event for each affected channel and wake up
+ * poll() on config_generation. The event code is a plain change event of
+ * the channel; observers read config_generation to tell changes apart.
+ */
+static void ltc5599_notify(struct iio_dev *indio_dev, unsigned long changed)
 {
 	struct ltc5599 *st = iio_priv(indio_dev);
-	int ret;
-	uint8_t tmp = st->shadowregs[LTC5599_FREQ_REG];
+	s64 timestamp = iio_get_time_ns(indio_dev);
+	unsigned int chan;
 
-	tmp = (tmp & ~LTC5599_FREQ_MASK) | LTC5599_FREQ_VALUE(val);
+	if (!changed)
+		return;
 
-	ret = ltc5599_write(indio_dev, LTC5599_FREQ_REG, tmp);
-	if (ret)
-		return ret;
-	st->shadowregs[LTC5599_FREQ_REG] = tmp;
-	return 0;
+	atomic_inc(&st->generation);
+
+	for (chan = 0; chan < 2; chan++) {
+		if (!(changed & (LTC5599_SHARED_REGS | BIT(LTC5599_OFFSI_REG + chan))))
+			continue;
+		iio_push_event(indio_dev,
+			       IIO_UNMOD_EVENT_CODE(IIO_ALTVOLTAGE, chan,
+						    IIO_EV_TYPE_CHANGE,
+						    IIO_EV_DIR_NONE),
+			       timestamp);
+	}
+
+	sysfs_notify(&indio_dev->dev.kobj, NULL, "config_generation");
 }
 
-static int ltc5599_read_freq(struct iio_dev *indio_dev, unsigned int *val)
+/*
+ * Put a burst writing regs from the first to the last register in mask
+ * into st->data. Returns the length of the burst.
+ */
+static unsigned int __ltc5599_fill_burst(struct ltc5599 *st, const u8 *regs,
+	unsigned long mask)
 {
-	struct ltc5599 *st = iio_priv(indio_dev);
-	u8 tmp;
-	int ret;
+	unsigned int first = __ffs(mask), last = __fls(mask);
 
-	ret = ltc5599_read(indio_dev, LTC5599_FREQ_REG, &tmp);
-	if (ret)
-		return ret;
+	st->data[0] = LTC5599_ADDR(first) & (~LTC5599_READ_OPERATION);
+	memcpy(&st->data[1], &regs[first], last - first + 1);
 
-	st->shadowregs[LTC5599_FREQ_REG] = tmp;
-	*val = st->shadowregs[LTC5599_FREQ_REG] & LTC5599_FREQ_MASK;
-	return 0;
+	return last - first + 2;
 }
 
-static int ltc5599_write_gain(struct iio_dev *indio_dev, unsigned int val)
+/*
+ * Put a burst spanning the first to the last register in which regs
+ * differs from the shadow image into st->data. Returns the bitmask of
+ * changed registers, 0 if there is nothing to write.
+ * Caller must hold indio_dev->mlock.
+ */
+static unsigned long __ltc5599_prepare(struct ltc5599 *st, const u8 *regs,
+	unsigned int *len)
 {
-	struct ltc5599 *st = iio_priv(indio_dev);
-	int ret;
-	uint8_t tmp = st->shadowregs[LTC5599_GAIN_REG];
+	unsigned long changed = 0;
+	unsigned int i;
 
-	tmp = (tmp & ~LTC5599_GAIN_MASK) | LTC5599_GAIN_VALUE(val);
+	for (i = 0; i < LTC5599_NUM_REGS; i++)
+		if (regs[i] != st->shadowregs[i])
+			changed |= BIT(i);
+	if (!changed)
+		return 0;
 
-	ret = ltc5599_write(indio_dev, LTC5599_GAIN_REG, tmp);
-	if (ret)
-		return ret;
-	st->shadowregs[LTC5599_GAIN_REG] = tmp;
-	return 0;
+	*len = __ltc5599_fill_burst(st, regs, changed);
+
+	return changed;
 }
 
-static int ltc5599_read_gain(struct iio_dev *indio_dev, unsigned int *val)
+/*
+ * Set up a message writing the burst of length len in st->data. With
+ * verify, a chip select toggle ends the write and the same registers are
+ * read back into st->rx within the same message.
+ */
+static void ltc5599_burst_message(struct ltc5599 *st, struct spi_message *m,
+	struct spi_transfer *x, unsigned int len, bool verify)
 {
-	struct ltc5599 *st = iio_priv(indio_dev);
-	u8 tmp;
-	int ret;
+	memset(x, 0, 2 * sizeof(*x));
+	x[0].tx_buf = st->data;
+	x[0].len = len;
 
-	ret = ltc5599_read(indio_dev, LTC5599_GAIN_REG, &tmp);
-	if (ret)
-		return ret;
+	if (verify) {
+		x[0].cs_change = 1;
+		st->vtx[0] = st->data[0] | LTC5599_READ_OPERATION;
+		memset(&st->vtx[1], 0xFF, len - 1);
+		x[1].tx_buf = st->vtx;
+		x[1].rx_buf = st->rx;
+		x[1].len = len;
+	}
 
-	st->shadowregs[LTC5599_GAIN_REG] = tmp;
-	*val = st->shadowregs[LTC5599_GAIN_REG] & LTC5599_GAIN_MASK;
-	return 0;
+	spi_message_init_with_transfers(m, x, verify ? 2 : 1);
 }
 
-static int ltc5599_write_offset(struct iio_dev *indio_dev, unsigned int chan, int val)
+/*
+ * Check the read back of a verified burst of length len in st->rx against
+ * regs and write the registers that differ again until they match.
+ * Returns 0, -EIO if they still differ after LTC5599_VERIFY_RETRIES
+ * rewrites, or another negative error code.
+ * Caller must hold indio_dev->mlock.
+ */
+static int __ltc5599_verify(struct ltc5599 *st, const u8 *regs,
+	unsigned int len)
 {
-	struct ltc5599 *st = iio_priv(indio_dev);
+	struct spi_transfer x[2];
+	struct spi_message m;
+	unsigned long mismatch;
+	unsigned int first, retry, i;
 	int ret;
-	
-	if (chan > 1)
-		return -EINVAL;
-	
-	if (val > 127)
-		val = 127;
-	if (val < -127)
-		val = -127;
 
-	val += 128;
+	for (retry = 0; ; retry++) {
+		first = st->data[0] >> 1;
+		mismatch = 0;
+		for (i = first; i < first + len - 1; i++)
+			if ((st->rx[1 + i - first] ^ regs[i]) & ltc5599_persistent_mask[i])
+				mismatch |= BIT(i);
+		if (!mismatch)
+			return 0;
 
-	u8 tmp = LTC5599_OFFS_VALUE(val);
+		st->verify_failures++;
+		if (retry == LTC5599_VERIFY_RETRIES)
+			return -EIO;
 
-	ret = ltc5599_write(indio_dev, LTC5599_OFFSI_REG+chan, tmp);
-	if (ret)
-		return ret;
-	st->shadowregs[LTC5599_OFFSI_REG+chan] = tmp;
-	return 0;
+		len = __ltc5599_fill_burst(st, regs, mismatch);
+		ltc5599_burst_message(st, &m, x, len, true);
+		ret = spi_sync(st->spi, &m);
+		if (ret)
+			return ret;
+	}
 }
 
-static int ltc5599_read_offset(struct iio_dev *indio_dev, unsigned int chan, int *val)
+/*
+ * Append a change to the log. Writers are serialized by mlock, readers
+ * take no lock: an entry is valid while its seq equals the sequence number
+ * the reader is looking for, and seq is moved off that value before the
+ * entry is reused. Caller must hold indio_dev->mlock.
+ */
+static void __ltc5599_log(struct ltc5599 *st, const u8 *regs,
+	unsigned long changed, enum ltc5599_source src)
 {
-	struct ltc5599 *st = iio_priv(indio_dev);
-	u8 tmp;
+	u32 head = st->log_head;
+	struct ltc5599_change *e = &st->log[head % LTC5599_LOG_ENTRIES];
 
-	int ret;
+	WRITE_ONCE(e->seq, head - 1);
+	smp_wmb();
+	e->timestamp_ns = ktime_get_ns();
+	e->changed = changed;
+	e->source = src;
+	memcpy(e->regs, regs, LTC5599_NUM_REGS);
+	smp_store_release(&e->seq, head);
+	smp_store_release(&st->log_head, head + 1);
+}
 
-	if (chan > 1)
-		return -EINVAL;
+/*
+ * The burst prepared for regs has been written: take regs over as the new
+ * shadow image, log the change and notify observers.
+ * Caller must hold indio_dev->mlock.
+ */
+static void __ltc5599_complete(struct iio_dev *indio_dev, const u8 *regs,
+	unsigned long changed, enum ltc5599_source src)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	unsigned int i;
 
-	ret = ltc5599_read(indio_dev, LTC5599_OFFSI_REG+chan, &tmp);
-	if (ret)
-		return ret;
-	st->shadowregs[LTC5599_OFFSI_REG+chan] = tmp;
-	*val = st->shadowregs[LTC5599_OFFSI_REG+chan];
-	*val -= 128;
+	write_seqcount_begin(&st->seq);
+	for (i = 0; i < LTC5599_NUM_REGS; i++)
+		st->shadowregs[i] = regs[i] & ltc5599_persistent_mask[i];
+	write_seqcount_end(&st->seq);
 
-	return 0;
+	__ltc5599_log(st, regs, changed, src);
+	ltc5599_notify(indio_dev, changed);
 }
 
-static int ltc5599_write_iqgainratio(struct iio_dev *indio_dev, int val)
+/*
+ * Write the registers in which regs differs from the shadow image with a
+ * single burst, then update the shadow image. Returns the bitmask of
+ * changed registers or a negative error code.
+ * Caller must hold indio_dev->mlock.
+ */
+static int __ltc5599_commit(struct iio_dev *indio_dev, const u8 *regs,
+	enum ltc5599_source src)
 {
 	struct ltc5599 *st = iio_priv(indio_dev);
+	bool verify = READ_ONCE(st->verify_writes);
+	struct spi_transfer x[2];
+	struct spi_message m;
+	unsigned long changed;
+	unsigned int len;
 	int ret;
-	uint8_t tmp = LTC5599_IQ_GAINRAT_VALUE(val);
 
-       	tmp ^= 0x80;
+	if (!memcmp(regs, st->shadowregs, LTC5599_NUM_REGS))
+		return 0;
 
-	ret = ltc5599_write(indio_dev, LTC5599_IQ_GAINRAT_REG, tmp);
+	ret = ltc5599_pm_get(st);
 	if (ret)
 		return ret;
-	st->shadowregs[LTC5599_IQ_GAINRAT_REG] = tmp;
-	return 0;
+
+	changed = __ltc5599_prepare(st, regs, &len);
+	ltc5599_burst_message(st, &m, x, len, verify);
+	ret = spi_sync(st->spi, &m);
+	if (!ret && verify)
+		ret = __ltc5599_verify(st, regs, len);
+	ltc5599_pm_put(st);
+	if (ret)
+		return ret;
+
+	__ltc5599_complete(indio_dev, regs, changed, src);
+
+	return changed;
 }
 
-static int ltc5599_read_iqgainratio(struct iio_dev *indio_dev, int *val)
+/*
+ * Copy the shadow image without taking any lock; retries if a commit
+ * raced with the copy.
+ */
+static void ltc5599_snapshot(struct ltc5599 *st, u8 *regs)
 {
-	struct ltc5599 *st = iio_priv(indio_dev);
-	u8 tmp;
-	int ret;
+	unsigned int seq;
 
-	ret = ltc5599_read(indio_dev, LTC5599_IQ_GAINRAT_REG, &tmp);
-	if (ret)
-		return ret;
+	do {
+		seq = read_seqcount_begin(&st->seq);
+		memcpy(regs, st->shadowregs, LTC5599_NUM_REGS);
+	} while (read_seqcount_retry(&st->seq, seq));
+}
 
-	st->shadowregs[LTC5599_IQ_GAINRAT_REG] = tmp;
-	*val = st->shadowregs[LTC5599_IQ_GAINRAT_REG];
-       	*val -= 128;
-	return 0;
+static void ltc5599_encode_freq(u8 *regs, unsigned int val)
+{
+	regs[LTC5599_FREQ_REG] = (regs[LTC5599_FREQ_REG] & ~LTC5599_FREQ_MASK) |
+		LTC5599_FREQ_VALUE(val);
 }
 
-static int ltc5599_write_iqphasebalance(struct iio_dev *indio_dev, int val)
+static void ltc5599_encode_gain(u8 *regs, unsigned int val)
 {
-	struct ltc5599 *st = iio_priv(indio_dev);
-	int ret, coarse;
-	uint8_t tmp1;
-	uint8_t tmp2 = st->shadowregs[LTC5599_FREQ_REG];
-	
+	regs[LTC5599_GAIN_REG] = (regs[LTC5599_GAIN_REG] & ~LTC5599_GAIN_MASK) |
+		LTC5599_GAIN_VALUE(val);
+}
+
+static void ltc5599_encode_gain_bit(u8 *regs, u8 bit, bool val)
+{
+	if (val)
+		regs[LTC5599_GAIN_REG] |= bit;
+	else
+		regs[LTC5599_GAIN_REG] &= ~bit;
+}
+
+static void ltc5599_encode_offset(u8 *regs, unsigned int chan, int val)
+{
+	if (val > 127)
+		val = 127;
+	if (val < -127)
+		val = -127;
+
+	val += 128;
+
+	regs[LTC5599_OFFSI_REG + chan] = LTC5599_OFFS_VALUE(val);
+}
+
+static void ltc5599_encode_iqgainratio(u8 *regs, int val)
+{
+	regs[LTC5599_IQ_GAINRAT_REG] = LTC5599_IQ_GAINRAT_VALUE(val) ^ 0x80;
+}
+
+static void ltc5599_encode_iqphasebalance(u8 *regs, int val)
+{
+	int coarse;
+
 	if (val < -16)
-		tmp2 &= ~LTC5599_IQ_PHASEBAL_EXT_SIGN_BIT;
+		regs[LTC5599_FREQ_REG] &= ~LTC5599_IQ_PHASEBAL_EXT_SIGN_BIT;
 	else
-		tmp2 |= LTC5599_IQ_PHASEBAL_EXT_SIGN_BIT;
-	
+		regs[LTC5599_FREQ_REG] |= LTC5599_IQ_PHASEBAL_EXT_SIGN_BIT;
+
 	if (val>0)
         	coarse = (val+16) / 32;
         else
         	coarse = (15-val) / 32;
 
-	tmp1 = LTC5599_IQ_PHASEBAL_EXT_VALUE(coarse) | LTC5599_IQ_PHASEBAL_FINE_VALUE((val & 0x1F) ^ 0x10);
-
-	ret = ltc5599_write(indio_dev, LTC5599_IQ_PHASEBAL_REG, tmp1);
-	if (ret)
-		return ret;
-	st->shadowregs[LTC5599_IQ_PHASEBAL_REG] = tmp1;
-	
-	ret = ltc5599_write(indio_dev, LTC5599_FREQ_REG, tmp2);
-	if (ret)
-		return ret;
-
-	st->shadowregs[LTC5599_FREQ_REG] = tmp2;
-	return 0;
+	regs[LTC5599_IQ_PHASEBAL_REG] = LTC5599_IQ_PHASEBAL_EXT_VALUE(coarse) |
+		LTC5599_IQ_PHASEBAL_FINE_VALUE((val & 0x1F) ^ 0x10);
 }
 
-static int ltc5599_read_iqphasebalance(struct iio_dev *indio_dev, int *val)
+static int ltc5599_decode_iqphasebalance(const u8 *regs)
 {
-	struct ltc5599 *st = iio_priv(indio_dev);
-	u8 tmp;
-	int ret, multiplier, coarse;
-
-	ret = ltc5599_read(indio_dev, LTC5599_FREQ_REG, &tmp);
-	if (ret)
-		return ret;
-	st->shadowregs[LTC5599_FREQ_REG] = tmp;
+	int multiplier, coarse, val;
 
-	if (tmp & LTC5599_IQ_PHASEBAL_EXT_SIGN_BIT)
+	if (regs[LTC5599_FREQ_REG] & LTC5599_IQ_PHASEBAL_EXT_SIGN_BIT)
 		multiplier = 1;
 	else
 		multiplier = -1;
 
-	ret = ltc5599_read(indio_dev, LTC5599_IQ_PHASEBAL_REG, &tmp);
-	if (ret)
-		return ret;
-	st->shadowregs[LTC5599_IQ_PHASEBAL_REG] = tmp;
+	coarse = (regs[LTC5599_IQ_PHASEBAL_REG] & LTC5599_IQ_PHASEBAL_EXT_MASK) >>
+		LTC5599_IQ_PHASEBAL_EXT_SHIFT;
 
-	coarse = (tmp & LTC5599_IQ_PHASEBAL_EXT_MASK) >> LTC5599_IQ_PHASEBAL_EXT_SHIFT;
+	val = (regs[LTC5599_IQ_PHASEBAL_REG] & LTC5599_IQ_PHASEBAL_FINE_MASK) - 16;
+	val += multiplier * coarse * 32;
 
-	*val = (tmp & LTC5599_IQ_PHASEBAL_FINE_MASK) - 16;
-	*val += multiplier * coarse * 32;
-
-	return 0;
+	return val;
 }
 
-static int ltc5599_fill_shadowregs(struct iio_dev *indio_dev)
+/*
+ * Nominal IQ correction step sizes: the phase balance covers +-2.5 degrees
+ * in 1/96 degree steps, the gain ratio +-0.5 dB in 1/256 dB steps. The
+ * tables follow the register encoding so that converting a register image
+ * to physical units is two lookups.
+ */
+
+/* phase of the coarse field (LTC5599_IQ_PHASEBAL_EXT), in microdegrees */
+static const int ltc5599_phase_coarse_udeg[8] = {
+	0, 333333, 666667, 1000000, 1333333, 1666667, 2000000, 2333333,
+};
+
+/* phase of the fine field (LTC5599_IQ_PHASEBAL_FINE), in microdegrees */
+static const int ltc5599_phase_fine_udeg[32] = {
+	-166667, -156250, -145833, -135417, -125000, -114583, -104167, -93750,
+	-83333, -72917, -62500, -52083, -41667, -31250, -20833, -10417,
+	0, 10417, 20833, 31250, 41667, 52083, 62500, 72917,
+	83333, 93750, 104167, 114583, 125000, 135417, 145833, 156250,
+};
+
+/* gain ratio of the upper and lower nibble of LTC5599_IQ_GAINRAT_REG, in micro-dB */
+static const int ltc5599_gainrat_hi_udb[16] = {
+	-500000, -437500, -375000, -312500, -250000, -187500, -125000, -62500,
+	0, 62500, 125000, 187500, 250000, 312500, 375000, 437500,
+};
+
+static const int ltc5599_gainrat_lo_udb[16] = {
+	0, 3906, 7813, 11719, 15625, 19531, 23438, 27344,
+	31250, 35156, 39063, 42969, 46875, 50781, 54688, 58594,
+};
+
+static int ltc5599_phase_regs_to_udeg(const u8 *regs)
 {
-	struct ltc5599 *st = iio_priv(indio_dev);
-	memset(st->shadowregs, 0x00, 32);
-	st->shadowregs[LTC5599_FREQ_REG] 	= 0x2E;
-	st->shadowregs[LTC5599_GAIN_REG] 	= 0x84;
-	st->shadowregs[LTC5599_OFFSI_REG] 	= 0x80;
-	st->shadowregs[LTC5599_OFFSQ_REG] 	= 0x80;
-	st->shadowregs[LTC5599_IQ_GAINRAT_REG] 	= 0x80;
-	st->shadowregs[LTC5599_IQ_PHASEBAL_REG] = 0x10;
-	st->shadowregs[LTC5599_LOMATCH_OVR_REG] = 0x50;
-	st->shadowregs[LTC5599_TEMPCORR_OVR_REG] = 0x06;
-	st->shadowregs[LTC5599_MODE_REG] 	= 0x00;
+	unsigned int coarse, fine;
+	int val;
 
-	return 0;
+	coarse = (regs[LTC5599_IQ_PHASEBAL_REG] & LTC5599_IQ_PHASEBAL_EXT_MASK) >>
+		LTC5599_IQ_PHASEBAL_EXT_SHIFT;
+	fine = regs[LTC5599_IQ_PHASEBAL_REG] & LTC5599_IQ_PHASEBAL_FINE_MASK;
+
+	val = ltc5599_phase_coarse_udeg[coarse];
+	if (!(regs[LTC5599_FREQ_REG] & LTC5599_IQ_PHASEBAL_EXT_SIGN_BIT))
+		val = -val;
+
+	return val + ltc5599_phase_fine_udeg[fine];
 }
 
-static int ltc5599_init_registers(struct iio_dev *indio_dev)
+static int ltc5599_gainrat_regs_to_udb(const u8 *regs)
 {
-	struct ltc5599 *st = iio_priv(indio_dev);
+	u8 tmp = regs[LTC5599_IQ_GAINRAT_REG];
 
-	return 0;
+	return ltc5599_gainrat_hi_udb[tmp >> 4] + ltc5599_gainrat_lo_udb[tmp & 0x0F];
 }
 
-static unsigned int freq_to_ctrl_word(unsigned int freq_in_khz)
+static int ltc5599_phase_code_to_udeg(int code)
 {
-	if (freq_in_khz > 1249100)
-        	return 1;
-	else if (freq_in_khz > 1248600)
-        	return 2;
-	else if (freq_in_khz > 1238100)
-        	return 3;
-	else if (freq_in_khz > 1214100)
-        	return 4;
-	else if (freq_in_khz > 1191200)
-        	return 5;
-	else if (freq_in_khz > 1165600)
-        	return 6;
-	else if (freq_in_khz > 1141000)
-        	return 7;
-	else if (freq_in_khz > 1120600)
-        	return 8;
-	else if (freq_in_khz > 1100500)
-        	return 9;
-	else if (freq_in_khz > 1069500)
-        	return 10;
-	else if (freq_in_khz > 1039599)
-        	return 11;
-	else if (freq_in_khz > 1023100)
-        	return 12;
-	else if (freq_in_khz > 1007100)
-        	return 13;
-	else if (freq_in_khz > 988300)
-        	return 14;
-	else if (freq_in_khz > 961800)
-        	return 15;
-	else if (freq_in_khz > 941300)
-        	return 16;
-	else if (freq_in_khz > 921500)
-        	return 17;
-	else if (freq_in_khz > 895200)
-        	return 18;
-	else if (freq_in_khz > 877600)
-        	return 19;
-	else if (freq_in_khz > 863600)
-        	return 20;
-	else if (freq_in_khz > 843200)
-        	return 21;
-	else if (freq_in_khz > 826900)
-        	return 22;
-	else if (freq_in_khz > 807000)
-        	return 23;
-	else if (freq_in_khz > 792300)
-        	return 24;
-	else if (freq_in_khz > 772200)
-        	return 25;
-	else if (freq_in_khz > 752700)
-        	return 26;
-	else if (freq_in_khz > 734000)
-        	return 27;
-	else if (freq_in_khz > 724200)
-        	return 28;
-	else if (freq_in_khz > 704600)
-        	return 29;
-	else if (freq_in_khz > 688700)
-        	return 30;
-	else if (freq_in_khz > 673200)
-        	return 31;
-	else if (freq_in_khz > 655200)
-        	return 32;
-	else if (freq_in_khz > 638100)
-        	return 33;
-	else if (freq_in_khz > 624600)
-        	return 34;
-	else if (freq_in_khz > 611900)
-        	return 35;
-	else if (freq_in_khz > 598400)
-        	return 36;
-	else if (freq_in_khz > 585100)
-        	return 37;
-	else if (freq_in_khz > 573900)
-        	return 38;
-	else if (freq_in_khz > 563100)
-        	return 39;
-	else if (freq_in_khz > 548100)
-        	return 40;
-	else if (freq_in_khz > 538100)
-        	return 41;
-	else if (freq_in_khz > 529100)
-        	return 42;
-	else if (freq_in_khz > 518500)
-        	return 43;
-	else if (freq_in_khz > 507000)
-        	return 44;
-	else if (freq_in_khz > 497700)
-        	return 45;
-	else if (freq_in_khz > 488000)
-        	return 46;
-	else if (freq_in_khz > 471500)
-        	return 47;
-	else if (freq_in_khz > 457700)
-        	return 48;
-	else if (freq_in_khz > 448700)
-        	return 49;
-	else if (freq_in_khz > 437400)
-        	return 50;
-	else if (freq_in_khz > 426600)
-        	return 51;
-	else if (freq_in_khz > 417500)
-        	return 52;
-	else if (freq_in_khz > 407500)
-        	return 53;
-	else if (freq_in_khz > 398000)
-        	return 54;
-	else if (freq_in_khz > 390100)
-        	return 55;
-	else if (freq_in_khz > 382800)
-        	return 56;
-	else if (freq_in_khz > 376600)
-        	return 57;
-	else if (freq_in_khz > 369800)
-        	return 58;
-	else if (freq_in_khz > 353100)
-        	return 59;
-	else if (freq_in_khz > 339000)
-        	return 60;
-	else if (freq_in_khz > 332600)
-        	return 61;
-	else if (freq_in_khz > 327200)
-        	return 62;
-	else if (freq_in_khz > 320600)
-        	return 63;
-	else if (freq_in_khz > 313700)
-        	return 64;
-	else if (freq_in_khz > 309100)
-        	return 65;
-	else if (freq_in_khz > 304500)
-        	return 66;
-	else if (freq_in_khz > 288100)
-        	return 67;
-	else if (freq_in_khz > 278300)
-        	return 68;
-	else if (freq_in_khz > 274200)
-        	return 69;
-	else if (freq_in_khz > 270300)
-        	return 70;
-	else if (freq_in_khz > 266000)
-        	return 71;
-	else if (freq_in_khz > 261899)
-        	return 72;
-	else if (freq_in_khz > 258200)
-        	return 73;
-	else if (freq_in_khz > 254100)
-        	return 74;
-	else if (freq_in_khz > 243600)
-        	return 75;
-	else if (freq_in_khz > 233800)
-        	return 76;
-	else if (freq_in_khz > 230800)
-        	return 77;
-	else if (freq_in_khz > 228000)
-        	return 78;
-	else if (freq_in_khz > 220200)
-        	return 79;
-	else if (freq_in_khz > 212600)
-        	return 80;
-	else if (freq_in_khz > 210000)
-        	return 81;
-	else if (freq_in_khz > 207600)
-        	return 82;
-	else if (freq_in_khz > 202100)
-        	return 83;
-	else if (freq_in_khz > 196200)
-        	return 84;
-	else if (freq_in_khz > 193700)
-        	return 85;
-	else if (freq_in_khz > 191200)
-        	return 86;
-	else if (freq_in_khz > 186600)
-        	return 87;
-	else if (freq_in_khz > 182000)
-        	return 88;
-	else if (freq_in_khz > 179400)
-        	return 89;
-	else if (freq_in_khz > 176000)
-        	return 90;
-	else if (freq_in_khz > 170100)
-        	return 91;
-	else if (freq_in_khz > 165000)
-        	return 92;
-	else if (freq_in_khz > 162500)
-        	return 93;
-	else if (freq_in_khz > 160000)
-        	return 94;
-	else if (freq_in_khz > 156700)
-        	return 95;
-	else if (freq_in_khz > 153600)
-        	return 96;
-	else if (freq_in_khz > 151100)
-        	return 97;
-	else if (freq_in_khz > 148600)
-        	return 98;
-	else if (freq_in_khz > 142500)
-        	return 99;
-	else if (freq_in_khz > 139600)
-        	return 100;
-	else if (freq_in_khz > 136500)
-        	return 101;
-	else if (freq_in_khz > 134300)
-        	return 102;
-	else if (freq_in_khz > 131200)
-        	return 103;
-	else if (freq_in_khz > 128100)
-        	return 104;
-	else if (freq_in_khz > 126000)
-        	return 105;
-	else if (freq_in_khz > 123800)
-        	return 106;
-	else if (freq_in_khz > 121300)
-        	return 107;
-	else if (freq_in_khz > 118300)
-        	return 108;
-	else if (freq_in_khz > 115700)
-        	return 109;
-	else if (freq_in_khz > 113500)
-        	return 110;
-	else if (freq_in_khz > 111300)
-        	return 111;
-	else if (freq_in_khz > 109500)
-        	return 112;
-	else if (freq_in_khz > 107600)
-        	return 113;
-	else if (freq_in_khz > 105600)
-        	return 114;
-	else if (freq_in_khz > 103000)
-        	return 115;
-	else if (freq_in_khz > 100300)
-        	return 116;
-	else if (freq_in_khz > 98500)
-        	return 117;
-	else if (freq_in_khz > 96600)
-        	return 118;
-	else if (freq_in_khz > 94700)
-        	return 119;
-	else if (freq_in_khz > 93000)
-        	return 120;
-	else 
-        	return 121;
-}
+	u8 regs[LTC5599_NUM_REGS] = {};
 
+	ltc5599_encode_iqphasebalance(regs, code);
+	return ltc5599_phase_regs_to_udeg(regs);
+}
 
-static int ltc5599_read_raw(struct iio_dev *indio_dev,
-	struct iio_chan_spec const *chan, int *val, int *val2, long info)
+static int ltc5599_gainrat_code_to_udb(int code)
 {
-	int ret;
-	unsigned int tmp;
-	long long tmp2;
-
-	switch (info) {
-	case IIO_CHAN_INFO_OFFSET:
-		ret = ltc5599_read_offset(indio_dev, chan->address, val);
-		if (ret)
-			return ret;
-		return IIO_VAL_INT;
-	case IIO_CHAN_INFO_FREQUENCY:
-		ret = ltc5599_read_freq(indio_dev, &tmp);
-		if (ret)
-			return ret;
-		tmp2 = -553LL * (int)tmp * (int)tmp * (int)tmp;
-		tmp2 += 198810LL * (int)tmp * (int)tmp;
-		tmp2 += -26120002LL * (int)tmp;
-		tmp2 += 1319492809LL;
-		*val = (int)tmp2;
-		return IIO_VAL_INT;
-	case IIO_CHAN_INFO_HARDWAREGAIN:
-		ret = ltc5599_read_gain(indio_dev, &tmp);
-		if (ret)
-			return ret;
-		*val = -1 * (int)tmp;
-		*val2 = 0;
-		return IIO_VAL_INT_PLUS_MICRO_DB;
-	case IIO_CHAN_INFO_QUADRATURE_CORRECTION_RAW:
-		ret = ltc5599_read_iqgainratio(indio_dev, val);
-		if (ret)
-			return ret;
-		return IIO_VAL_INT;
-	case IIO_CHAN_INFO_PHASE:
-		ret = ltc5599_read_iqphasebalance(indio_dev, val);
-		if (ret)
-			return ret;
-		return IIO_VAL_INT;
-	default:
-		break;
-	}
+	u8 regs[LTC5599_NUM_REGS] = {};
 
-	return -EINVAL;
+	ltc5599_encode_iqgainratio(regs, code);
+	return ltc5599_gainrat_regs_to_udb(regs);
+}
+
+/*
+ * Find the code in [min, max] whose physical value is closest to phys.
+ * to_phys() must be monotonically increasing, which both conversions are.
+ */
+static int ltc5599_nearest_code(int (*to_phys)(int), int min, int max, int phys)
+{
+	int lo = min, hi = max, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (to_phys(mid) < phys)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo > min && phys - to_phys(lo - 1) < to_phys(lo) - phys)
+		lo--;
+
+	return lo;
+}
+
+/* attenuation code that brings a band to the target output level */
+static unsigned int ltc5599_level_to_atten(int flatness_mdb, int target_mdb)
+{
+	int atten = DIV_ROUND_CLOSEST(flatness_mdb - target_mdb, 1000);
+
+	return clamp(atten, 0, LTC5599_GAIN_MAX_ATTEN);
+}
+
+/*
+ * Select a LO band. Everything that depends on the band is encoded here so
+ * that it is committed in the same burst as LTC5599_FREQ_REG.
+ */
+static int ltc5599_encode_band(struct ltc5599 *st, u8 *regs, unsigned int band)
+{
+	const struct ltc5599_band_cal *cal;
+
+	if (band > LTC5599_NUM_BANDS)
+		return -EINVAL;
+
+	cal = &st->cal[band];
+	ltc5599_encode_freq(regs, band);
+
+	if (cal->valid & LTC5599_CAL_OFFSET) {
+		ltc5599_encode_offset(regs, 0, cal->offset[0]);
+		ltc5599_encode_offset(regs, 1, cal->offset[1]);
+	}
+
+	if (cal->valid & LTC5599_CAL_IQ) {
+		ltc5599_encode_iqgainratio(regs, cal->gain_ratio);
+		ltc5599_encode_iqphasebalance(regs, cal->phase);
+	}
+
+	/*
+	 * Bands without an override get the chip default while any band has
+	 * one or the register still holds one, e.g. after the last override
+	 * was dropped.
+	 */
+	if (cal->valid & LTC5599_CAL_LO_MATCH) {
+		regs[LTC5599_LOMATCH_OVR_REG] = cal->lo_match;
+		st->lo_match_active = true;
+	} else if (st->lo_match_bands || st->lo_match_active) {
+		regs[LTC5599_LOMATCH_OVR_REG] = LTC5599_LOMATCH_DEFAULT;
+		st->lo_match_active = false;
+	}
+
+	if (st->level_en)
+		ltc5599_encode_gain(regs, ltc5599_level_to_atten(cal->flatness_mdb,
+							 st->target_level_mdb));
+
+	return 0;
+}
+
+static int ltc5599_read_freq(struct iio_dev *indio_dev, unsigned int *val)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	u8 regs[LTC5599_NUM_REGS];
+
+	ltc5599_snapshot(st, regs);
+	*val = regs[LTC5599_FREQ_REG] & LTC5599_FREQ_MASK;
+	return 0;
+}
+
+static int ltc5599_read_gain(struct iio_dev *indio_dev, unsigned int *val)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	u8 regs[LTC5599_NUM_REGS];
+
+	ltc5599_snapshot(st, regs);
+	*val = regs[LTC5599_GAIN_REG] & LTC5599_GAIN_MASK;
+	return 0;
+}
+
+static int ltc5599_read_offset(struct iio_dev *indio_dev, unsigned int chan, int *val)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	u8 regs[LTC5599_NUM_REGS];
+
+	if (chan > 1)
+		return -EINVAL;
+
+	ltc5599_snapshot(st, regs);
+	*val = regs[LTC5599_OFFSI_REG+chan];
+	*val -= 128;
+
+	return 0;
+}
+
+static int ltc5599_read_iqgainratio(struct iio_dev *indio_dev, int *val)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	u8 regs[LTC5599_NUM_REGS];
+
+	ltc5599_snapshot(st, regs);
+	*val = regs[LTC5599_IQ_GAINRAT_REG];
+	*val -= 128;
+	return 0;
+}
+
+static int ltc5599_read_iqphasebalance(struct iio_dev *indio_dev, int *val)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	u8 regs[LTC5599_NUM_REGS];
+
+	ltc5599_snapshot(st, regs);
+	*val = ltc5599_decode_iqphasebalance(regs);
+
+	return 0;
+}
+
+static int ltc5599_fill_shadowregs(struct iio_dev *indio_dev)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	memset(st->shadowregs, 0x00, 32);
+	st->shadowregs[LTC5599_FREQ_REG] 	= 0x2E;
+	st->shadowregs[LTC5599_GAIN_REG] 	= 0x84;
+	st->shadowregs[LTC5599_OFFSI_REG] 	= 0x80;
+	st->shadowregs[LTC5599_OFFSQ_REG] 	= 0x80;
+	st->shadowregs[LTC5599_IQ_GAINRAT_REG] 	= 0x80;
+	st->shadowregs[LTC5599_IQ_PHASEBAL_REG] = 0x10;
+	st->shadowregs[LTC5599_LOMATCH_OVR_REG] = LTC5599_LOMATCH_DEFAULT;
+	st->shadowregs[LTC5599_TEMPCORR_OVR_REG] = 0x06;
+	st->shadowregs[LTC5599_MODE_REG] 	= 0x00;
+
+	return 0;
+}
+
+/*
+ * Bring the chip back in line with the shadow registers: optionally issue a
+ * software reset, then write the complete register image in one burst.
+ * Both go out in a single spi_message, so recovering from a suspend or a
+ * brownout costs one bus transaction. The reset bit is never part of the
+ * restored image. Caller must hold indio_dev->mlock.
+ */
+static int __ltc5599_restore(struct iio_dev *indio_dev, bool reset)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	struct spi_transfer x[2] = {};
+	unsigned int n = 0;
+
+	if (reset) {
+		st->cmd[0] = LTC5599_ADDR(LTC5599_MODE_REG) & (~LTC5599_READ_OPERATION);
+		st->cmd[1] = st->shadowregs[LTC5599_MODE_REG] | LTC5599_RESET_BIT;
+		x[n].tx_buf = st->cmd;
+		x[n].len = 2;
+		x[n].cs_change = 1;
+		x[n].cs_change_delay.value = LTC5599_RESET_DELAY_US;
+		x[n].cs_change_delay.unit = SPI_DELAY_UNIT_USECS;
+		n++;
+	}
+
+	st->data[0] = LTC5599_ADDR(LTC5599_FREQ_REG) & (~LTC5599_READ_OPERATION);
+	memcpy(&st->data[1], st->shadowregs, LTC5599_NUM_REGS);
+	st->data[1 + LTC5599_MODE_REG] &= ~LTC5599_RESET_BIT;
+	x[n].tx_buf = st->data;
+	x[n].len = LTC5599_NUM_REGS + 1;
+	n++;
+
+	return spi_sync_transfer(st->spi, x, n);
+}
+
+/* reset and restore a chip that is up and running */
+static int ltc5599_reset_and_restore(struct iio_dev *indio_dev)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	int ret;
+
+	mutex_lock(&indio_dev->mlock);
+	ret = ltc5599_pm_get(st);
+	if (!ret) {
+		ret = __ltc5599_restore(indio_dev, true);
+		ltc5599_pm_put(st);
+	}
+	mutex_unlock(&indio_dev->mlock);
+
+	return ret;
+}
+
+/* runtime PM is not set up yet, the chip is powered from probe on */
+static int ltc5599_init_registers(struct iio_dev *indio_dev)
+{
+	int ret;
+
+	mutex_lock(&indio_dev->mlock);
+	ret = __ltc5599_restore(indio_dev, true);
+	mutex_unlock(&indio_dev->mlock);
+
+	return ret;
+}
+
+/*
+ * Read n registers starting at addr in a single transfer. The values land
+ * in st->rx[1..n]. Caller must hold indio_dev->mlock.
+ */
+static int __ltc5599_read_burst(struct iio_dev *indio_dev, u8 addr, unsigned int n)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+
+	st->data[0] = LTC5599_ADDR(addr) | LTC5599_READ_OPERATION;
+	memset(&st->data[1], 0xFF, n);
+
+	return spi_read_while_write(st->spi, st->data, st->rx, n + 1);
+}
+
+/* every data line level and transition in both directions */
+static const u8 ltc5599_spi_patterns[][LTC5599_SPI_TUNE_LEN] = {
+	{ 0x00, 0xFF, 0x00, 0xFF },
+	{ 0xFF, 0x00, 0xFF, 0x00 },
+	{ 0x55, 0xAA, 0x55, 0xAA },
+	{ 0xAA, 0x55, 0xAA, 0x55 },
+	{ 0x01, 0x02, 0x04, 0x08 },
+	{ 0x10, 0x20, 0x40, 0x80 },
+	{ 0xFE, 0xFD, 0xFB, 0xF7 },
+	{ 0xEF, 0xDF, 0xBF, 0x7F },
+};
+
+/*
+ * Write each test pattern with one burst and read it back with another at
+ * the current SPI clock. Returns the number of bit errors or a negative
+ * error code. Clobbers the chip registers, the caller restores them.
+ * Caller must hold indio_dev->mlock.
+ */
+static int __ltc5599_spi_test(struct iio_dev *indio_dev)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	unsigned int pass, p, i;
+	int errors = 0, ret;
+
+	for (pass = 0; pass < LTC5599_SPI_TUNE_PASSES; pass++) {
+		for (p = 0; p < ARRAY_SIZE(ltc5599_spi_patterns); p++) {
+			st->data[0] = LTC5599_ADDR(LTC5599_SPI_TUNE_FIRST) &
+				      (~LTC5599_READ_OPERATION);
+			memcpy(&st->data[1], ltc5599_spi_patterns[p],
+			       LTC5599_SPI_TUNE_LEN);
+			ret = spi_read_while_write(st->spi, st->data, NULL,
+						   LTC5599_SPI_TUNE_LEN + 1);
+			if (!ret)
+				ret = __ltc5599_read_burst(indio_dev,
+							   LTC5599_SPI_TUNE_FIRST,
+							   LTC5599_SPI_TUNE_LEN);
+			if (ret)
+				return ret;
+
+			st->spi_tune_bursts++;
+			for (i = 0; i < LTC5599_SPI_TUNE_LEN; i++)
+				errors += hweight8(st->rx[1 + i] ^
+						   ltc5599_spi_patterns[p][i]);
+		}
+	}
+
+	st->spi_tune_errors += errors;
+
+	return errors;
+}
+
+static int ltc5599_spi_set_speed(struct spi_device *spi, u32 hz)
+{
+	spi->max_speed_hz = hz;
+
+	return spi_setup(spi);
+}
+
+/*
+ * If adi,spi-autotune-max-hz is given, step the SPI clock up from the board
+ * default in 25% increments towards that limit while the pattern test
+ * passes. For margin the clock ends up one step below the highest rate that
+ * passed, or at the limit if no step failed. A board that fails at its
+ * default clock has broken wiring and does not probe. The register image
+ * is restored on every exit, at the selected clock if there is one.
+ */
+static int ltc5599_spi_autotune(struct iio_dev *indio_dev)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	struct spi_device *spi = st->spi;
+	u32 base = spi->max_speed_hz, limit, hz, best, prev;
+	int ret, err;
+
+	if (device_property_read_u32(&spi->dev, "adi,spi-autotune-max-hz", &limit))
+		return 0;
+
+	mutex_lock(&indio_dev->mlock);
+
+	ret = __ltc5599_spi_test(indio_dev);
+	if (ret) {
+		dev_err(&spi->dev, "SPI self-test failed at %u Hz: %d\n", base, ret);
+		ret = -EIO;
+		goto out_restore;
+	}
+
+	best = prev = base;
+	while (best < limit) {
+		hz = min(best + max(best / 4, 1U), limit);
+		ret = ltc5599_spi_set_speed(spi, hz);
+		if (!ret)
+			ret = __ltc5599_spi_test(indio_dev);
+		if (ret) {
+			best = prev;
+			break;
+		}
+		prev = best;
+		best = hz;
+	}
+
+	ret = ltc5599_spi_set_speed(spi, best);
+	if (!ret)
+		ret = __ltc5599_spi_test(indio_dev);
+	if (ret) {
+		dev_warn(&spi->dev, "SPI self-test failed at %u Hz, using %u Hz\n",
+			 best, base);
+		ret = ltc5599_spi_set_speed(spi, base);
+	}
+
+	dev_dbg(&spi->dev, "SPI clock %u Hz, %u bit errors in %u test bursts\n",
+		spi->max_speed_hz, st->spi_tune_errors, st->spi_tune_bursts);
+
+out_restore:
+	err = __ltc5599_restore(indio_dev, false);
+	if (!ret)
+		ret = err;
+	mutex_unlock(&indio_dev->mlock);
+
+	return ret;
+}
+
+static void ltc5599_scrub_schedule(struct ltc5599 *st)
+{
+	unsigned int interval = READ_ONCE(st->scrub_interval_ms);
+
+	if (interval)
+		kthread_queue_delayed_work(st->worker, &st->scrub_work,
+			msecs_to_jiffies(interval << st->scrub_backoff));
+}
+
+/*
+ * Compare the whole register file against the shadow registers with one
+ * burst read and rewrite it with one burst if the chip lost its
+ * configuration, e.g. after an ESD event. The scrubber never waits for the
+ * device: if someone else holds the lock it backs off and tries later.
+ */
+static void ltc5599_scrub_work(struct kthread_work *work)
+{
+	struct ltc5599 *st = container_of(work, struct ltc5599,
+					  scrub_work.work);
+	struct iio_dev *indio_dev = st->indio_dev;
+	unsigned long mismatch = 0;
+	int i, ret = 0;
+
+	if (!mutex_trylock(&indio_dev->mlock)) {
+		if (st->scrub_backoff < LTC5599_SCRUB_MAX_BACKOFF)
+			st->scrub_backoff++;
+		goto out;
+	}
+	st->scrub_backoff = 0;
+
+	/* a powered down chip is restored on resume, nothing to scrub */
+	if (!ltc5599_pm_get_if_active(st))
+		goto out_unlock;
+
+	ret = __ltc5599_read_burst(indio_dev, LTC5599_FREQ_REG, LTC5599_NUM_REGS);
+	if (!ret) {
+		for (i = 0; i < LTC5599_NUM_REGS; i++)
+			if ((st->rx[1 + i] ^ st->shadowregs[i]) & ltc5599_persistent_mask[i])
+				mismatch |= BIT(i);
+		if (mismatch)
+			ret = __ltc5599_restore(indio_dev, false);
+		if (mismatch && !ret) {
+			st->scrub_recoveries++;
+			__ltc5599_log(st, st->shadowregs, mismatch,
+				      LTC5599_SRC_SCRUB);
+			ltc5599_notify(indio_dev, mismatch);
+		}
+	}
+	ltc5599_pm_put_idle(st);
+out_unlock:
+	mutex_unlock(&indio_dev->mlock);
+
+	if (ret)
+		dev_warn_ratelimited(&st->spi->dev, "register scrub failed: %d\n", ret);
+
+out:
+	ltc5599_scrub_schedule(st);
+}
+
+/*
+ * Lower band edges in kHz, highest band first: a frequency above
+ * ltc5599_band_edges_khz[n] selects control word n + 1, anything at or
+ * below the last edge selects LTC5599_NUM_BANDS.
+ */
+static const unsigned int ltc5599_band_edges_khz[LTC5599_NUM_BANDS - 1] = {
+	1249100, 1248600, 1238100, 1214100, 1191200, 1165600, 1141000, 1120600,
+	1100500, 1069500, 1039599, 1023100, 1007100, 988300, 961800, 941300,
+	921500, 895200, 877600, 863600, 843200, 826900, 807000, 792300,
+	772200, 752700, 734000, 724200, 704600, 688700, 673200, 655200,
+	638100, 624600, 611900, 598400, 585100, 573900, 563100, 548100,
+	538100, 529100, 518500, 507000, 497700, 488000, 471500, 457700,
+	448700, 437400, 426600, 417500, 407500, 398000, 390100, 382800,
+	376600, 369800, 353100, 339000, 332600, 327200, 320600, 313700,
+	309100, 304500, 288100, 278300, 274200, 270300, 266000, 261899,
+	258200, 254100, 243600, 233800, 230800, 228000, 220200, 212600,
+	210000, 207600, 202100, 196200, 193700, 191200, 186600, 182000,
+	179400, 176000, 170100, 165000, 162500, 160000, 156700, 153600,
+	151100, 148600, 142500, 139600, 136500, 134300, 131200, 128100,
+	126000, 123800, 121300, 118300, 115700, 113500, 111300, 109500,
+	107600, 105600, 103000, 100300, 98500, 96600, 94700, 93000,
+};
+
+static unsigned int freq_to_ctrl_word(unsigned int freq_in_khz)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(ltc5599_band_edges_khz); i++)
+		if (freq_in_khz > ltc5599_band_edges_khz[i])
+			return i + 1;
+
+	return LTC5599_NUM_BANDS;
+}
+
+/*
+ * Middle of the frequency range in kHz that freq_to_ctrl_word() maps to a
+ * control word, so that writing it back selects the same band.
+ */
+static unsigned int ltc5599_band_mid_khz(unsigned int word)
+{
+	unsigned int lo = 30000, hi = 1300000;
+
+	if (word < LTC5599_NUM_BANDS)
+		lo = ltc5599_band_edges_khz[word - 1];
+	if (word > 1)
+		hi = ltc5599_band_edges_khz[word - 2];
+
+	return lo + (hi - lo) / 2;
+}
+
+/*
+ * Frequency in Hz reported for a control word, the band mid so that reads,
+ * writes and frequency_available agree. Word 0 reads as band 1.
+ */
+static int ctrl_word_to_freq(unsigned int word)
+{
+	return ltc5599_band_mid_khz(clamp_t(unsigned int, word, 1, LTC5599_NUM_BANDS)) * 1000;
+}
+
+static void ltc5599_fill_freq_avail(struct ltc5599 *st)
+{
+	unsigned int i;
+
+	/* ascending frequency, i.e. descending control word */
+	for (i = 0; i < LTC5599_NUM_BANDS; i++)
+		st->freq_avail[i] = ctrl_word_to_freq(LTC5599_NUM_BANDS - i);
+}
+
+/*
+ * Apply one parameter update to a register image, with the same range
+ * checks and clamping as write_raw.
+ */
+static int ltc5599_encode_update(struct ltc5599 *st, u8 *regs,
+	const struct ltc5599_update *upd)
+{
+	int val = upd->value;
+
+	switch (upd->param) {
+	case LTC5599_PARAM_OFFSET:
+		if (upd->index > 1)
+			return -EINVAL;
+		if ((val < -127) || (val > 127))
+			return -EINVAL;
+		ltc5599_encode_offset(regs, upd->index, val);
+		break;
+	case LTC5599_PARAM_FREQUENCY:
+		if ((val < 30000000) || (val > 1300000000))
+			return -EINVAL;
+		return ltc5599_encode_band(st, regs, freq_to_ctrl_word(val/1000));
+	case LTC5599_PARAM_HARDWAREGAIN:
+		if (val > 0)
+			return -EINVAL;
+		val = -val;
+		if (val > 19)
+			val = 19;
+		ltc5599_encode_gain(regs, val);
+		break;
+	case LTC5599_PARAM_QUADRATURE_CORRECTION:
+		if ((val < -127) || (val > 127))
+			return -EINVAL;
+		ltc5599_encode_iqgainratio(regs, val);
+		break;
+	case LTC5599_PARAM_PHASE:
+		if ((val < -240) || (val > 239))
+			return -EINVAL;
+		ltc5599_encode_iqphasebalance(regs, val);
+		break;
+	case LTC5599_PARAM_REG:
+		if (upd->index >= LTC5599_NUM_REGS)
+			return -EINVAL;
+		/* the band indexes the calibration store */
+		if (upd->index == LTC5599_FREQ_REG &&
+		    (val & LTC5599_FREQ_MASK) > LTC5599_NUM_BANDS)
+			return -EINVAL;
+		regs[upd->index] = val;
+		break;
+	case LTC5599_PARAM_QDISABLE:
+	case LTC5599_PARAM_AGCTRL:
+		if ((val < 0) || (val > 1))
+			return -EINVAL;
+		ltc5599_encode_gain_bit(regs, upd->param == LTC5599_PARAM_QDISABLE ?
+					LTC5599_QDISABLE_BIT : LTC5599_AGCTRL_BIT, val);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * Encode all updates on top of the shadow image and commit the result in
+ * one burst. Nothing is written if any of the updates is invalid.
+ * Caller must hold indio_dev->mlock.
+ */
+static int __ltc5599_apply(struct iio_dev *indio_dev,
+	const struct ltc5599_update *upd, unsigned int count,
+	enum ltc5599_source src)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	u8 regs[LTC5599_NUM_REGS];
+	unsigned int i;
+	int ret;
+
+	memcpy(regs, st->shadowregs, LTC5599_NUM_REGS);
+	for (i = 0; i < count; i++) {
+		ret = ltc5599_encode_update(st, regs, &upd[i]);
+		if (ret)
+			return ret;
+	}
+
+	ret = __ltc5599_commit(indio_dev, regs, src);
+
+	return ret < 0 ? ret : 0;
+}
+
+static int ltc5599_apply_updates(struct iio_dev *indio_dev,
+	const struct ltc5599_update *upd, unsigned int count,
+	enum ltc5599_source src)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	int ret;
+
+	/* the LO notifier and kernel consumers can outlive the IIO device */
+	mutex_lock(&indio_dev->mlock);
+	if (st->removed)
+		ret = -ENODEV;
+	else
+		ret = __ltc5599_apply(indio_dev, upd, count, src);
+	mutex_unlock(&indio_dev->mlock);
+
+	return ret;
+}
+
+static int ltc5599_apply_one(struct iio_dev *indio_dev,
+	enum ltc5599_param param, unsigned int index, int value,
+	enum ltc5599_source src)
+{
+	const struct ltc5599_update upd = {
+		.param = param,
+		.index = index,
+		.value = value,
+	};
+
+	return ltc5599_apply_updates(indio_dev, &upd, 1, src);
+}
+
+static int ltc5599_tune(struct iio_dev *indio_dev, unsigned long freq)
+{
+	if ((freq < 30000000) || (freq > 1300000000))
+		return -EINVAL;
+
+	return ltc5599_apply_one(indio_dev, LTC5599_PARAM_FREQUENCY, 0, freq,
+				 LTC5599_SRC_LO_CLK);
+}
+
+static LIST_HEAD(ltc5599_gangs);
+static DEFINE_MUTEX(ltc5599_gangs_lock);
+
+/* all gang members with a pending burst on one SPI controller */
+struct ltc5599_gang_bus {
+	struct work_struct	work;
+	struct ltc5599_gang	*gang;
+	struct spi_controller	*ctlr;
+};
+
+/*
+ * Write the pending bursts of all gang members on one controller back to
+ * back, without letting other devices on the bus in between.
+ */
+static void ltc5599_gang_bus_work(struct work_struct *work)
+{
+	struct ltc5599_gang_bus *bus = container_of(work,
+						    struct ltc5599_gang_bus, work);
+	struct spi_transfer x[2];
+	struct spi_message message;
+	struct ltc5599 *st;
+
+	spi_bus_lock(bus->ctlr);
+	list_for_each_entry(st, &bus->gang->members, gang_node) {
+		if (st->spi->controller != bus->ctlr || !st->gang_changed)
+			continue;
+
+		ltc5599_burst_message(st, &message, x, st->gang_len,
+				      st->gang_verify);
+		st->gang_ret = spi_sync_locked(st->spi, &message);
+		st->gang_done = ktime_get();
+	}
+	spi_bus_unlock(bus->ctlr);
+}
+
+/*
+ * Apply the same updates to every member of a gang. The bursts for chips
+ * on different controllers are issued in parallel from one work item per
+ * controller; chips sharing a controller go back to back under
+ * spi_bus_lock(). spi_async() cannot be used for the latter as it refuses
+ * to queue on a locked bus. Called with the gang lock held.
+ */
+static int __ltc5599_gang_apply_updates(struct ltc5599_gang *gang,
+	const struct ltc5599_update *upd, unsigned int count,
+	enum ltc5599_source src)
+{
+	struct ltc5599_gang_bus *buses;
+	ktime_t first = KTIME_MAX, last = 0;
+	unsigned int nbus = 0, i;
+	struct ltc5599 *st;
+	int ret = 0;
+
+	list_for_each_entry(st, &gang->members, gang_node)
+		mutex_lock_nest_lock(&st->indio_dev->mlock, &gang->lock);
+
+	list_for_each_entry(st, &gang->members, gang_node) {
+		ret = ltc5599_pm_get(st);
+		if (ret) {
+			list_for_each_entry_continue_reverse(st, &gang->members,
+							     gang_node)
+				ltc5599_pm_put(st);
+			goto out_unlock;
+		}
+	}
+
+	buses = kcalloc(gang->count, sizeof(*buses), GFP_KERNEL);
+	if (!buses) {
+		ret = -ENOMEM;
+		goto out_put;
+	}
+
+	list_for_each_entry(st, &gang->members, gang_node) {
+		memcpy(st->gang_regs, st->shadowregs, LTC5599_NUM_REGS);
+		for (i = 0; i < count; i++) {
+			ret = ltc5599_encode_update(st, st->gang_regs, &upd[i]);
+			if (ret)
+				goto out_free;
+		}
+
+		st->gang_ret = 0;
+		st->gang_verify = READ_ONCE(st->verify_writes);
+		st->gang_changed = __ltc5599_prepare(st, st->gang_regs, &st->gang_len);
+		if (!st->gang_changed)
+			continue;
+
+		for (i = 0; i < nbus; i++)
+			if (buses[i].ctlr == st->spi->controller)
+				break;
+		if (i == nbus) {
+			buses[nbus].gang = gang;
+			buses[nbus].ctlr = st->spi->controller;
+			INIT_WORK(&buses[nbus].work, ltc5599_gang_bus_work);
+			nbus++;
+		}
+	}
+
+	for (i = 0; i < nbus; i++)
+		queue_work(system_unbound_wq, &buses[i].work);
+	for (i = 0; i < nbus; i++)
+		flush_work(&buses[i].work);
+
+	list_for_each_entry(st, &gang->members, gang_node) {
+		if (!st->gang_changed)
+			continue;
+		/* mismatches are rewritten one by one, outside the bus lock */
+		if (!st->gang_ret && st->gang_verify)
+			st->gang_ret = __ltc5599_verify(st, st->gang_regs,
+							st->gang_len);
+		if (st->gang_ret) {
+			ret = st->gang_ret;
+			continue;
+		}
+		__ltc5599_complete(st->indio_dev, st->gang_regs, st->gang_changed,
+				   src);
+		if (ktime_before(st->gang_done, first))
+			first = st->gang_done;
+		if (ktime_after(st->gang_done, last))
+			last = st->gang_done;
+	}
+	if (last)
+		gang->skew_ns = ktime_to_ns(ktime_sub(last, first));
+
+out_free:
+	kfree(buses);
+out_put:
+	list_for_each_entry(st, &gang->members, gang_node)
+		ltc5599_pm_put(st);
+out_unlock:
+	list_for_each_entry(st, &gang->members, gang_node)
+		mutex_unlock(&st->indio_dev->mlock);
+
+	return ret;
+}
+
+/*
+ * Apply the updates to the gang of @st, or to @st alone if it is not (or
+ * no longer) in one. The gangs lock is held until the gang lock is taken
+ * so that ltc5599_gang_leave() cannot free the gang in between.
+ */
+static int ltc5599_gang_apply_updates(struct ltc5599 *st,
+	const struct ltc5599_update *upd, unsigned int count,
+	enum ltc5599_source src)
+{
+	struct ltc5599_gang *gang;
+	int ret;
+
+	mutex_lock(&ltc5599_gangs_lock);
+	gang = st->gang;
+	if (!gang) {
+		mutex_unlock(&ltc5599_gangs_lock);
+		return ltc5599_apply_updates(st->indio_dev, upd, count, src);
+	}
+	mutex_lock(&gang->lock);
+	mutex_unlock(&ltc5599_gangs_lock);
+
+	ret = __ltc5599_gang_apply_updates(gang, upd, count, src);
+	mutex_unlock(&gang->lock);
+
+	return ret;
+}
+
+/* settings shared by all chips of a gang are fanned out to every member */
+static int ltc5599_apply_shared(struct iio_dev *indio_dev,
+	enum ltc5599_param param, int value, enum ltc5599_source src)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	const struct ltc5599_update upd = {
+		.param = param,
+		.value = value,
+	};
+
+	return ltc5599_gang_apply_updates(st, &upd, 1, src);
+}
+
+/* called from remove and again from devres; the second call is a no-op */
+static void ltc5599_gang_leave(void *data)
+{
+	struct ltc5599 *st = data;
+	struct ltc5599_gang *gang;
+
+	mutex_lock(&ltc5599_gangs_lock);
+	gang = st->gang;
+	if (!gang) {
+		mutex_unlock(&ltc5599_gangs_lock);
+		return;
+	}
+
+	mutex_lock(&gang->lock);
+	list_del(&st->gang_node);
+	gang->count--;
+	mutex_unlock(&gang->lock);
+	if (!gang->count) {
+		list_del(&gang->node);
+		mutex_destroy(&gang->lock);
+		kfree(gang);
+	}
+	st->gang = NULL;
+	mutex_unlock(&ltc5599_gangs_lock);
+}
+
+static int ltc5599_gang_join(struct ltc5599 *st)
+{
+	struct device *dev = &st->spi->dev;
+	struct ltc5599_gang *gang;
+	u32 id;
+
+	if (device_property_read_u32(dev, "adi,gang-id", &id))
+		return 0;
+
+	mutex_lock(&ltc5599_gangs_lock);
+	list_for_each_entry(gang, &ltc5599_gangs, node)
+		if (gang->id == id)
+			goto found;
+
+	gang = kzalloc(sizeof(*gang), GFP_KERNEL);
+	if (!gang) {
+		mutex_unlock(&ltc5599_gangs_lock);
+		return -ENOMEM;
+	}
+	gang->id = id;
+	mutex_init(&gang->lock);
+	INIT_LIST_HEAD(&gang->members);
+	list_add_tail(&gang->node, &ltc5599_gangs);
+
+found:
+	mutex_lock(&gang->lock);
+	list_add_tail(&st->gang_node, &gang->members);
+	gang->count++;
+	mutex_unlock(&gang->lock);
+	st->gang = gang;
+	mutex_unlock(&ltc5599_gangs_lock);
+
+	return devm_add_action_or_reset(dev, ltc5599_gang_leave, st);
+}
+
+static int ltc5599_measure(struct iio_channel *chan, int *val)
+{
+	int ret;
+
+	ret = iio_read_channel_processed(chan, val);
+	if (ret == -EINVAL)
+		ret = iio_read_channel_raw(chan, val);
+
+	return ret < 0 ? ret : 0;
+}
+
+/* commit one candidate in a single burst and take one measurement */
+static int ltc5599_cal_probe(struct iio_dev *indio_dev, struct iio_channel *chan,
+			     const struct ltc5599_update *upd, unsigned int n,
+			     int *val, unsigned int *iter)
+{
+	int ret;
+
+	ret = __ltc5599_apply(indio_dev, upd, n, LTC5599_SRC_CAL);
+	if (ret)
+		return ret;
+
+	(*iter)++;
+
+	return ltc5599_measure(chan, val);
+}
+
+/*
+ * Null the LO leakage: coordinate descent over the I and Q offset codes,
+ * minimising the reading of the leakage power detector. Each probe point
+ * is one burst over both offset registers followed by one conversion.
+ * The result stays active and is stored for the current band.
+ */
+static int ltc5599_calibrate_leakage(struct iio_dev *indio_dev)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	struct ltc5599_update upd[2] = {
+		{ .param = LTC5599_PARAM_OFFSET, .index = 0 },
+		{ .param = LTC5599_PARAM_OFFSET, .index = 1 },
+	};
+	int x[2], cand[2], best, val, step, axis, dir, ret;
+	unsigned int iter = 0, band;
+	bool improved;
+
+	if (!st->leakage_chan)
+		return -ENODEV;
+
+	mutex_lock(&indio_dev->mlock);
+
+	band = st->shadowregs[LTC5599_FREQ_REG] & LTC5599_FREQ_MASK;
+	if (band > LTC5599_NUM_BANDS) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	x[0] = st->shadowregs[LTC5599_OFFSI_REG] - 128;
+	x[1] = st->shadowregs[LTC5599_OFFSQ_REG] - 128;
+	ret = ltc5599_measure(st->leakage_chan, &best);
+	if (ret)
+		goto out_unlock;
+
+	for (step = LTC5599_CAL_START_STEP; step; step /= 2) {
+		do {
+			improved = false;
+			for (axis = 0; axis < 2 && !improved; axis++) {
+				for (dir = -1; dir <= 1 && !improved; dir += 2) {
+					cand[0] = x[0];
+					cand[1] = x[1];
+					cand[axis] = clamp(x[axis] + dir * step, -127, 127);
+					if (cand[axis] == x[axis])
+						continue;
+
+					upd[0].value = cand[0];
+					upd[1].value = cand[1];
+					ret = ltc5599_cal_probe(indio_dev,
+								st->leakage_chan,
+								upd, 2, &val, &iter);
+					if (ret)
+						goto out_unlock;
+
+					if (val < best) {
+						best = val;
+						x[0] = cand[0];
+						x[1] = cand[1];
+						improved = true;
+					}
+				}
+			}
+		} while (improved && iter < LTC5599_CAL_MAX_ITER);
+	}
+
+	upd[0].value = x[0];
+	upd[1].value = x[1];
+	ret = __ltc5599_apply(indio_dev, upd, 2, LTC5599_SRC_CAL);
+	if (ret)
+		goto out_unlock;
+
+	st->cal[band].offset[0] = x[0];
+	st->cal[band].offset[1] = x[1];
+	st->cal[band].valid |= LTC5599_CAL_OFFSET;
+	st->leakage_iter = iter;
+	st->leakage_power = best;
+
+out_unlock:
+	mutex_unlock(&indio_dev->mlock);
+
+	return ret;
+}
+
+/*
+ * Maximise image rejection: successive parabolic search along the gain
+ * ratio and phase balance codes, minimising the reading of the image
+ * sideband power detector. Per axis the points x - h, x and x + h give
+ * a parabola whose vertex is probed next; the step h is halved once
+ * neither axis moves. Each candidate pair goes out in one burst.
+ */
+static int ltc5599_calibrate_image(struct iio_dev *indio_dev)
+{
+	static const int lo[2] = { -127, -240 }, hi[2] = { 127, 239 };
+	struct ltc5599 *st = iio_priv(indio_dev);
+	struct ltc5599_update upd[2] = {
+		{ .param = LTC5599_PARAM_QUADRATURE_CORRECTION },
+		{ .param = LTC5599_PARAM_PHASE },
+	};
+	int x[2], cand[2], f[3], best, initial, val, step, axis, i, ret;
+	unsigned int iter = 0, band;
+	s64 num, den;
+	bool moved;
+
+	if (!st->image_chan)
+		return -ENODEV;
+
+	mutex_lock(&indio_dev->mlock);
+
+	band = st->shadowregs[LTC5599_FREQ_REG] & LTC5599_FREQ_MASK;
+	if (band > LTC5599_NUM_BANDS) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	x[0] = st->shadowregs[LTC5599_IQ_GAINRAT_REG] - 128;
+	x[1] = ltc5599_decode_iqphasebalance(st->shadowregs);
+	ret = ltc5599_measure(st->image_chan, &best);
+	if (ret)
+		goto out_unlock;
+	initial = best;
+
+	step = LTC5599_CAL_IQ_START_STEP;
+	while (step && iter < LTC5599_CAL_MAX_ITER) {
+		moved = false;
+
+		for (axis = 0; axis < 2; axis++) {
+			int pt[3] = { x[axis] - step, x[axis], x[axis] + step };
+
+			pt[0] = max(pt[0], lo[axis]);
+			pt[2] = min(pt[2], hi[axis]);
+			f[1] = best;
+
+			for (i = 0; i < 3; i += 2) {
+				cand[0] = x[0];
+				cand[1] = x[1];
+				cand[axis] = pt[i];
+				if (pt[i] == x[axis]) {
+					f[i] = best;
+					continue;
+				}
+				upd[0].value = cand[0];
+				upd[1].value = cand[1];
+				ret = ltc5599_cal_probe(indio_dev, st->image_chan,
+							upd, 2, &f[i], &iter);
+				if (ret)
+					goto out_unlock;
+			}
+
+			/* vertex of the parabola through the three points */
+			cand[0] = x[0];
+			cand[1] = x[1];
+			den = (s64)f[0] - 2 * (s64)f[1] + f[2];
+			if (den > 0 && pt[0] < x[axis] && pt[2] > x[axis]) {
+				num = ((s64)f[0] - f[2]) * step;
+				cand[axis] = x[axis] + (int)div64_s64(num, 2 * den);
+				cand[axis] = clamp(cand[axis], lo[axis], hi[axis]);
+			}
+
+			val = INT_MAX;
+			if (cand[axis] != pt[0] && cand[axis] != x[axis] &&
+			    cand[axis] != pt[2]) {
+				upd[0].value = cand[0];
+				upd[1].value = cand[1];
+				ret = ltc5599_cal_probe(indio_dev, st->image_chan,
+							upd, 2, &val, &iter);
+				if (ret)
+					goto out_unlock;
+			}
+
+			/* move to the best of the points probed on this axis */
+			if (val < best && val <= f[0] && val <= f[2]) {
+				best = val;
+				x[axis] = cand[axis];
+				moved = true;
+			} else if (f[0] < best && f[0] <= f[2]) {
+				best = f[0];
+				x[axis] = pt[0];
+				moved = true;
+			} else if (f[2] < best) {
+				best = f[2];
+				x[axis] = pt[2];
+				moved = true;
+			}
+		}
+
+		if (!moved)
+			step /= 2;
+	}
+
+	upd[0].value = x[0];
+	upd[1].value = x[1];
+	ret = __ltc5599_apply(indio_dev, upd, 2, LTC5599_SRC_CAL);
+	if (ret)
+		goto out_unlock;
+
+	st->cal[band].gain_ratio = x[0];
+	st->cal[band].phase = x[1];
+	st->cal[band].valid |= LTC5599_CAL_IQ;
+	st->image_iter = iter;
+	st->image_power = best;
+	st->image_gain = initial - best;
+
+out_unlock:
+	mutex_unlock(&indio_dev->mlock);
+
+	return ret;
+}
+
+/* Caller must hold indio_dev->mlock. */
+static int __ltc5599_set_lo_match(struct ltc5599 *st, unsigned int band, int val)
+{
+	struct ltc5599_band_cal *cal;
+
+	if (band > LTC5599_NUM_BANDS || val < -1 || val > 0xFF)
+		return -EINVAL;
+
+	cal = &st->cal[band];
+
+	if (val < 0) {
+		if (cal->valid & LTC5599_CAL_LO_MATCH)
+			st->lo_match_bands--;
+		cal->valid &= ~LTC5599_CAL_LO_MATCH;
+		return 0;
+	}
+
+	if (!(cal->valid & LTC5599_CAL_LO_MATCH))
+		st->lo_match_bands++;
+	cal->valid |= LTC5599_CAL_LO_MATCH;
+	cal->lo_match = val;
+
+	return 0;
+}
+
+/* Caller must hold indio_dev->mlock. */
+static int __ltc5599_set_flatness(struct ltc5599 *st, unsigned int band, int val)
+{
+	if (band > LTC5599_NUM_BANDS || abs(val) > LTC5599_FLATNESS_MAX_MDB)
+		return -EINVAL;
+
+	st->cal[band].flatness_mdb = val;
+
+	return 0;
+}
+
+/* re-encode the current band so that changed band settings take effect */
+static int __ltc5599_refresh_band(struct iio_dev *indio_dev,
+	enum ltc5599_source src)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	u8 regs[LTC5599_NUM_REGS];
+	int ret;
+
+	memcpy(regs, st->shadowregs, sizeof(regs));
+	ret = ltc5599_encode_band(st, regs,
+				  st->shadowregs[LTC5599_FREQ_REG] & LTC5599_FREQ_MASK);
+	if (ret)
+		return ret;
+
+	ret = __ltc5599_commit(indio_dev, regs, src);
+
+	return ret < 0 ? ret : 0;
+}
+
+/*
+ * Per-band DT tables are <band value> pairs, band being the control word.
+ * set() validates and stores one value.
+ */
+static int ltc5599_parse_band_table(struct iio_dev *indio_dev, const char *prop,
+	int (*set)(struct ltc5599 *st, unsigned int band, int val))
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	struct device *dev = &st->spi->dev;
+	u32 *table;
+	int i, n, ret;
+
+	n = device_property_count_u32(dev, prop);
+	if (n <= 0)
+		return 0;
+	if (n % 2) {
+		dev_err(dev, "invalid %s\n", prop);
+		return -EINVAL;
+	}
+
+	table = kcalloc(n, sizeof(*table), GFP_KERNEL);
+	if (!table)
+		return -ENOMEM;
+
+	ret = device_property_read_u32_array(dev, prop, table, n);
+	if (ret)
+		goto out_free;
+
+	mutex_lock(&indio_dev->mlock);
+	for (i = 0; i < n; i += 2) {
+		if (!table[i] || table[i] > LTC5599_NUM_BANDS)
+			ret = -EINVAL;
+		else
+			ret = set(st, table[i], (s32)table[i + 1]);
+		if (ret) {
+			dev_err(dev, "invalid %s entry %d\n", prop, i / 2);
+			break;
+		}
+	}
+	if (!ret)
+		ret = __ltc5599_refresh_band(indio_dev, LTC5599_SRC_CAL);
+	mutex_unlock(&indio_dev->mlock);
+
+out_free:
+	kfree(table);
+	return ret;
+}
+
+static int ltc5599_setup_cal(struct iio_dev *indio_dev)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	int ret;
+
+	ret = ltc5599_parse_band_table(indio_dev, "adi,lo-match-table",
+				       __ltc5599_set_lo_match);
+	if (ret)
+		return ret;
+
+	ret = ltc5599_parse_band_table(indio_dev, "adi,gain-flatness-table",
+				       __ltc5599_set_flatness);
+	if (ret)
+		return ret;
+
+	st->leakage_chan = devm_iio_channel_get(&st->spi->dev, "leakage");
+	if (IS_ERR(st->leakage_chan)) {
+		if (PTR_ERR(st->leakage_chan) != -ENODEV)
+			return PTR_ERR(st->leakage_chan);
+		st->leakage_chan = NULL;
+	}
+
+	st->image_chan = devm_iio_channel_get(&st->spi->dev, "image");
+	if (IS_ERR(st->image_chan)) {
+		if (PTR_ERR(st->image_chan) != -ENODEV)
+			return PTR_ERR(st->image_chan);
+		st->image_chan = NULL;
+	}
+
+	return 0;
+}
+
+static u8 ltc5599_temp_corr_code(struct ltc5599 *st, int temp)
+{
+	unsigned int i;
+
+	for (i = st->num_temp_corr - 1; i > 0; i--)
+		if (temp >= st->temp_corr[i].temp)
+			break;
+
+	return st->temp_corr[i].code;
+}
+
+static void ltc5599_temp_schedule(struct ltc5599 *st)
+{
+	if (st->temp_chan)
+		kthread_queue_delayed_work(st->worker, &st->temp_work,
+			msecs_to_jiffies(LTC5599_TEMP_POLL_MS << st->temp_backoff));
+}
+
+/*
+ * Follow the board temperature: once it moved by more than the threshold
+ * since the last correction, either write the matching entry of the
+ * correction override table or, without a table, pulse TEMPUPDT so the
+ * chip re-reads its own sensor. Nothing is written while the temperature
+ * stays within the threshold, and the poll slows down meanwhile.
+ */
+static void ltc5599_temp_work(struct kthread_work *work)
+{
+	struct ltc5599 *st = container_of(work, struct ltc5599,
+					  temp_work.work);
+	struct iio_dev *indio_dev = st->indio_dev;
+	u8 regs[LTC5599_NUM_REGS];
+	int temp, ret;
+
+	/*
+	 * Nothing is corrected while runtime suspended; the resume flags the
+	 * correction as stale and requeues this work right away.
+	 */
+	if (ltc5599_pm_suspended(st))
+		goto out;
+
+	ret = ltc5599_measure(st->temp_chan, &temp);
+	if (ret) {
+		dev_warn_ratelimited(&st->spi->dev,
+				     "temperature read failed: %d\n", ret);
+		goto out;
+	}
+
+	mutex_lock(&indio_dev->mlock);
+	if (READ_ONCE(st->temp_stale)) {
+		WRITE_ONCE(st->temp_stale, false);
+		st->temp_valid = false;
+	}
+	if (st->temp_valid &&
+	    abs(temp - st->temp_last) < READ_ONCE(st->temp_threshold)) {
+		if (st->temp_backoff < LTC5599_TEMP_MAX_BACKOFF)
+			st->temp_backoff++;
+		mutex_unlock(&indio_dev->mlock);
+		goto out;
+	}
+	st->temp_backoff = 0;
+
+	memcpy(regs, st->shadowregs, sizeof(regs));
+	if (st->num_temp_corr)
+		regs[LTC5599_TEMPCORR_OVR_REG] = ltc5599_temp_corr_code(st, temp);
+	else
+		regs[LTC5599_GAIN_REG] |= LTC5599_TEMPUPDT_BIT;
+
+	ret = __ltc5599_commit(indio_dev, regs, LTC5599_SRC_TEMP);
+	if (ret >= 0) {
+		if (ret & BIT(LTC5599_TEMPCORR_OVR_REG))
+			st->temp_overrides++;
+		else if (ret)
+			st->temp_pulses++;
+		st->temp_last = temp;
+		st->temp_valid = true;
+	}
+	mutex_unlock(&indio_dev->mlock);
+
+	if (ret < 0)
+		dev_warn_ratelimited(&st->spi->dev,
+				     "temperature correction failed: %d\n", ret);
+
+out:
+	ltc5599_temp_schedule(st);
+}
+
+static int ltc5599_setup_temp(struct iio_dev *indio_dev)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	struct device *dev = &st->spi->dev;
+	u32 table[2 * LTC5599_TEMP_CORR_MAX];
+	int i, n, ret;
+
+	st->temp_threshold = LTC5599_TEMP_THRESHOLD;
+	kthread_init_delayed_work(&st->temp_work, ltc5599_temp_work);
+
+	st->temp_chan = devm_iio_channel_get(dev, "temp");
+	if (IS_ERR(st->temp_chan)) {
+		if (PTR_ERR(st->temp_chan) != -ENODEV)
+			return PTR_ERR(st->temp_chan);
+		st->temp_chan = NULL;
+		return 0;
+	}
+
+	n = device_property_count_u32(dev, "adi,temp-corr-table");
+	if (n <= 0)
+		return 0;
+	if (n % 2 || n > ARRAY_SIZE(table)) {
+		dev_err(dev, "invalid adi,temp-corr-table\n");
+		return -EINVAL;
+	}
+
+	ret = device_property_read_u32_array(dev, "adi,temp-corr-table", table, n);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < n / 2; i++) {
+		if (table[2 * i + 1] > LTC5599_TEMPCORR_OVR_MASK) {
+			dev_err(dev, "adi,temp-corr-table code %u out of range\n",
+				table[2 * i + 1]);
+			return -EINVAL;
+		}
+		st->temp_corr[i].temp = (s32)table[2 * i];
+		st->temp_corr[i].code = table[2 * i + 1];
+		if (i && st->temp_corr[i].temp <= st->temp_corr[i - 1].temp) {
+			dev_err(dev, "adi,temp-corr-table not ascending\n");
+			return -EINVAL;
+		}
+	}
+	st->num_temp_corr = n / 2;
+
+	return 0;
+}
+
+static int ltc5599_read_raw(struct iio_dev *indio_dev,
+	struct iio_chan_spec const *chan, int *val, int *val2, long info)
+{
+	int ret;
+	unsigned int tmp;
+
+	switch (info) {
+	case IIO_CHAN_INFO_OFFSET:
+		ret = ltc5599_read_offset(indio_dev, chan->address, val);
+		if (ret)
+			return ret;
+		return IIO_VAL_INT;
+	case IIO_CHAN_INFO_FREQUENCY:
+		ret = ltc5599_read_freq(indio_dev, &tmp);
+		if (ret)
+			return ret;
+		*val = ctrl_word_to_freq(tmp);
+		return IIO_VAL_INT;
+	case IIO_CHAN_INFO_HARDWAREGAIN:
+		ret = ltc5599_read_gain(indio_dev, &tmp);
+		if (ret)
+			return ret;
+		*val = -1 * (int)tmp;
+		*val2 = 0;
+		return IIO_VAL_INT_PLUS_MICRO_DB;
+	case IIO_CHAN_INFO_QUADRATURE_CORRECTION_RAW:
+		ret = ltc5599_read_iqgainratio(indio_dev, val);
+		if (ret)
+			return ret;
+		return IIO_VAL_INT;
+	case IIO_CHAN_INFO_PHASE:
+		ret = ltc5599_read_iqphasebalance(indio_dev, val);
+		if (ret)
+			return ret;
+		return IIO_VAL_INT;
+	default:
+		break;
+	}
+
+	return -EINVAL;
 }
 
 static int ltc5599_write_raw(struct iio_dev *indio_dev,
 	struct iio_chan_spec const *chan, int val, int val2, long info)
 {
-	struct ltc5599 *st = iio_priv(indio_dev);
 	int ret;
-	unsigned int tmp;
 
-	switch (info) {
-	case IIO_CHAN_INFO_OFFSET:
-		if ((val < -127) || (val > 127))
-			return -EINVAL;
-		ret = ltc5599_write_offset(indio_dev, chan->address, val);
-		break;
-	case IIO_CHAN_INFO_FREQUENCY:
-		if ((val < 30000000) || (val > 1300000000))
-			return -EINVAL;
-		tmp = freq_to_ctrl_word(val/1000);
+	switch (info) {
+	case IIO_CHAN_INFO_OFFSET:
+		ret = ltc5599_apply_one(indio_dev, LTC5599_PARAM_OFFSET,
+					chan->address, val, LTC5599_SRC_SYSFS);
+		break;
+	case IIO_CHAN_INFO_FREQUENCY:
+		ret = ltc5599_apply_shared(indio_dev, LTC5599_PARAM_FREQUENCY, val,
+					   LTC5599_SRC_SYSFS);
+		break;
+	case IIO_CHAN_INFO_HARDWAREGAIN:
+		ret = ltc5599_apply_shared(indio_dev, LTC5599_PARAM_HARDWAREGAIN, val,
+					   LTC5599_SRC_SYSFS);
+		break;
+	case IIO_CHAN_INFO_QUADRATURE_CORRECTION_RAW:
+		ret = ltc5599_apply_one(indio_dev,
+					LTC5599_PARAM_QUADRATURE_CORRECTION, 0, val,
+					LTC5599_SRC_SYSFS);
+		break;
+	case IIO_CHAN_INFO_PHASE:
+		ret = ltc5599_apply_one(indio_dev, LTC5599_PARAM_PHASE, 0, val,
+					LTC5599_SRC_SYSFS);
+		break;
+	default:
+		ret = -EINVAL;
+	}
+
+	return ret;
+}
+
+static const int ltc5599_code_avail[] = { -127, 1, 127 };
+static const int ltc5599_phase_avail[] = { -240, 1, 239 };
+static const int ltc5599_gain_avail[] = { -19, 0, 1, 0, 0, 0 };
+
+static int ltc5599_read_avail(struct iio_dev *indio_dev,
+	struct iio_chan_spec const *chan, const int **vals, int *type,
+	int *length, long info)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+
+	switch (info) {
+	case IIO_CHAN_INFO_OFFSET:
+	case IIO_CHAN_INFO_QUADRATURE_CORRECTION_RAW:
+		*vals = ltc5599_code_avail;
+		*type = IIO_VAL_INT;
+		*length = ARRAY_SIZE(ltc5599_code_avail);
+		return IIO_AVAIL_RANGE;
+	case IIO_CHAN_INFO_PHASE:
+		*vals = ltc5599_phase_avail;
+		*type = IIO_VAL_INT;
+		*length = ARRAY_SIZE(ltc5599_phase_avail);
+		return IIO_AVAIL_RANGE;
+	case IIO_CHAN_INFO_HARDWAREGAIN:
+		*vals = ltc5599_gain_avail;
+		*type = IIO_VAL_INT_PLUS_MICRO_DB;
+		*length = ARRAY_SIZE(ltc5599_gain_avail);
+		return IIO_AVAIL_RANGE;
+	case IIO_CHAN_INFO_FREQUENCY:
+		*vals = st->freq_avail;
+		*type = IIO_VAL_INT;
+		*length = LTC5599_NUM_BANDS;
+		return IIO_AVAIL_LIST;
+	default:
+		break;
+	}
+
+	return -EINVAL;
+}
+
+static const char * const ltc5599_scan_labels[LTC5599_SCAN_NUM] = {
+	[LTC5599_SCAN_OFFSET_I] = "i",
+	[LTC5599_SCAN_OFFSET_Q] = "q",
+	[LTC5599_SCAN_HARDWAREGAIN] = "hardwaregain",
+	[LTC5599_SCAN_QUADRATURE_CORRECTION] = "quadrature_correction",
+	[LTC5599_SCAN_PHASE] = "phase",
+};
+
+static int ltc5599_read_label(struct iio_dev *indio_dev,
+	struct iio_chan_spec const *chan, char *label)
+{
+	return sysfs_emit(label, "%s\n", ltc5599_scan_labels[chan->scan_index]);
+}
+
+static ssize_t ltc5599_read_band_edges(struct iio_dev *indio_dev,
+	uintptr_t private, const struct iio_chan_spec *chan, char *buf)
+{
+	int i, len = 0;
+
+	for (i = ARRAY_SIZE(ltc5599_band_edges_khz) - 1; i >= 0; i--)
+		len += sysfs_emit_at(buf, len, "%u%c",
+				     ltc5599_band_edges_khz[i] * 1000,
+				     i ? ' ' : '\n');
+
+	return len;
+}
+
+enum ltc5599_phys_attr {
+	LTC5599_PHYS_PHASE,
+	LTC5599_PHYS_GAINRAT,
+};
+
+/* phase in millidegrees and gain ratio in milli-dB, both with micro fraction */
+static ssize_t ltc5599_read_phys(struct iio_dev *indio_dev,
+	uintptr_t private, const struct iio_chan_spec *chan, char *buf)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	u8 regs[LTC5599_NUM_REGS];
+	int vals[2], tmp;
+
+	ltc5599_snapshot(st, regs);
+
+	switch (private) {
+	case LTC5599_PHYS_PHASE:
+		tmp = ltc5599_phase_regs_to_udeg(regs);
+		break;
+	case LTC5599_PHYS_GAINRAT:
+		tmp = ltc5599_gainrat_regs_to_udb(regs);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	vals[0] = tmp / 1000;
+	vals[1] = (tmp % 1000) * 1000;
+
+	return iio_format_value(buf, IIO_VAL_INT_PLUS_MICRO, 2, vals);
+}
+
+static ssize_t ltc5599_write_phys(struct iio_dev *indio_dev,
+	uintptr_t private, const struct iio_chan_spec *chan,
+	const char *buf, size_t len)
+{
+	int integer, fract, tmp, ret;
+
+	ret = iio_str_to_fixpoint(buf, 100000, &integer, &fract);
+	if (ret)
+		return ret;
+
+	if (abs(integer) > 10000)
+		return -EINVAL;
+	/* the sign is on integer, or on fract if integer is 0 */
+	if (integer < 0)
+		fract = -fract;
+	tmp = integer * 1000 + fract / 1000;
+
+	switch (private) {
+	case LTC5599_PHYS_PHASE:
+		tmp = ltc5599_nearest_code(ltc5599_phase_code_to_udeg, -240, 239, tmp);
+		ret = ltc5599_apply_one(indio_dev, LTC5599_PARAM_PHASE, 0, tmp,
+					LTC5599_SRC_SYSFS);
+		break;
+	case LTC5599_PHYS_GAINRAT:
+		tmp = ltc5599_nearest_code(ltc5599_gainrat_code_to_udb, -127, 127, tmp);
+		ret = ltc5599_apply_one(indio_dev,
+					LTC5599_PARAM_QUADRATURE_CORRECTION, 0, tmp,
+					LTC5599_SRC_SYSFS);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return ret ? ret : len;
+}
+
+static const struct iio_chan_spec_ext_info ltc5599_ext_info[] = {
+	{
+		.name = "frequency_band_edges",
+		.shared = IIO_SHARED_BY_TYPE,
+		.read = ltc5599_read_band_edges,
+	},
+	{
+		.name = "phase_mdeg",
+		.shared = IIO_SHARED_BY_TYPE,
+		.read = ltc5599_read_phys,
+		.write = ltc5599_write_phys,
+		.private = LTC5599_PHYS_PHASE,
+	},
+	{
+		.name = "quadrature_correction_mdb",
+		.shared = IIO_SHARED_BY_TYPE,
+		.read = ltc5599_read_phys,
+		.write = ltc5599_write_phys,
+		.private = LTC5599_PHYS_GAINRAT,
+	},
+	{ },
+};
+
+/*
+ * Keep the band in step with the LO clock. By default the band follows
+ * after the rate change; with adi,lo-retune-pre-rate-change it is switched
+ * before the PLL retunes and switched back if the change is aborted.
+ * Rates outside the band range are left to the other consumers of the
+ * clock; only a failed band switch ahead of the change vetoes it.
+ */
+static int ltc5599_lo_notifier(struct notifier_block *nb,
+	unsigned long event, void *data)
+{
+	struct ltc5599 *st = container_of(nb, struct ltc5599, lo_nb);
+	struct clk_notifier_data *cnd = data;
+	unsigned long rate;
+	int ret;
+
+	if (event == st->lo_event)
+		rate = cnd->new_rate;
+	else if (event == ABORT_RATE_CHANGE && st->lo_event == PRE_RATE_CHANGE)
+		rate = cnd->old_rate;
+	else
+		return NOTIFY_DONE;
+
+	/* still registered until devres runs; ltc5599_tune() rechecks locked */
+	if (READ_ONCE(st->removed))
+		return NOTIFY_DONE;
+
+	if ((rate < 30000000) || (rate > 1300000000)) {
+		dev_warn_ratelimited(&st->spi->dev,
+				     "LO rate %lu out of range, band not changed\n", rate);
+		return NOTIFY_DONE;
+	}
+
+	ret = ltc5599_tune(st->indio_dev, rate);
+	if (ret)
+		dev_warn_ratelimited(&st->spi->dev,
+				     "failed to follow LO rate %lu: %d\n", rate, ret);
+
+	if (event != PRE_RATE_CHANGE)
+		return NOTIFY_DONE;
+
+	return notifier_from_errno(ret);
+}
+
+static void ltc5599_clk_disable(void *data)
+{
+	clk_disable_unprepare(data);
+}
+
+static int ltc5599_setup_lo_clk(struct iio_dev *indio_dev)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	struct device *dev = &st->spi->dev;
+	int ret;
+
+	st->lo_clk = devm_clk_get_optional(dev, "lo");
+	if (IS_ERR(st->lo_clk))
+		return PTR_ERR(st->lo_clk);
+	if (!st->lo_clk)
+		return 0;
+
+	ret = clk_prepare_enable(st->lo_clk);
+	if (ret)
+		return ret;
+
+	ret = devm_add_action_or_reset(dev, ltc5599_clk_disable, st->lo_clk);
+	if (ret)
+		return ret;
+
+	if (device_property_read_bool(dev, "adi,lo-retune-pre-rate-change"))
+		st->lo_event = PRE_RATE_CHANGE;
+	else
+		st->lo_event = POST_RATE_CHANGE;
+
+	ret = ltc5599_tune(indio_dev, clk_get_rate(st->lo_clk));
+	if (ret)
+		dev_warn(dev, "LO rate %lu out of range\n", clk_get_rate(st->lo_clk));
+
+	st->lo_nb.notifier_call = ltc5599_lo_notifier;
+
+	return devm_clk_notifier_register(dev, st->lo_clk, &st->lo_nb);
+}
+
+static ssize_t recover_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	bool val;
+	int ret;
+
+	ret = kstrtobool(buf, &val);
+	if (ret)
+		return ret;
+	if (!val)
+		return len;
+
+	ret = ltc5599_reset_and_restore(indio_dev);
+	if (ret)
+		return ret;
+
+	return len;
+}
+
+static ssize_t scrub_interval_ms_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct ltc5599 *st = iio_priv(dev_to_iio_dev(dev));
+
+	return sysfs_emit(buf, "%u\n", READ_ONCE(st->scrub_interval_ms));
+}
+
+static ssize_t scrub_interval_ms_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct ltc5599 *st = iio_priv(dev_to_iio_dev(dev));
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &val);
+	if (ret)
+		return ret;
+
+	if (val && val < LTC5599_SCRUB_MIN_INTERVAL_MS)
+		val = LTC5599_SCRUB_MIN_INTERVAL_MS;
+
+	WRITE_ONCE(st->scrub_interval_ms, val);
+	if (val)
+		kthread_mod_delayed_work(st->worker, &st->scrub_work,
+					 msecs_to_jiffies(val));
+	else
+		kthread_cancel_delayed_work_sync(&st->scrub_work);
+
+	return len;
+}
+
+static ssize_t scrub_recoveries_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct ltc5599 *st = iio_priv(indio_dev);
+	unsigned int val;
+
+	mutex_lock(&indio_dev->mlock);
+	val = st->scrub_recoveries;
+	mutex_unlock(&indio_dev->mlock);
+
+	return sysfs_emit(buf, "%u\n", val);
+}
+
+static ssize_t temp_threshold_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct ltc5599 *st = iio_priv(dev_to_iio_dev(dev));
+
+	return sysfs_emit(buf, "%d\n", READ_ONCE(st->temp_threshold));
+}
+
+static ssize_t temp_threshold_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct ltc5599 *st = iio_priv(dev_to_iio_dev(dev));
+	int val, ret;
+
+	ret = kstrtoint(buf, 0, &val);
+	if (ret)
+		return ret;
+	if (val < 0)
+		return -EINVAL;
+
+	WRITE_ONCE(st->temp_threshold, val);
+
+	return len;
+}
+
+static ssize_t temp_corrections_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct ltc5599 *st = iio_priv(indio_dev);
+	unsigned int pulses, overrides;
+
+	mutex_lock(&indio_dev->mlock);
+	pulses = st->temp_pulses;
+	overrides = st->temp_overrides;
+	mutex_unlock(&indio_dev->mlock);
+
+	return sysfs_emit(buf, "%u %u\n", pulses, overrides);
+}
+
+static ssize_t spi_speed_hz_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct ltc5599 *st = iio_priv(dev_to_iio_dev(dev));
+
+	return sysfs_emit(buf, "%u\n", st->spi->max_speed_hz);
+}
+
+static ssize_t spi_tune_errors_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct ltc5599 *st = iio_priv(indio_dev);
+	unsigned int bursts, errors;
+
+	mutex_lock(&indio_dev->mlock);
+	bursts = st->spi_tune_bursts;
+	errors = st->spi_tune_errors;
+	mutex_unlock(&indio_dev->mlock);
+
+	return sysfs_emit(buf, "%u %u\n", bursts, errors);
+}
+
+static int ltc5599_set_rt_priority(struct ltc5599 *st, unsigned int prio)
+{
+	struct sched_attr attr = {
+		.sched_policy = prio ? SCHED_FIFO : SCHED_NORMAL,
+		.sched_priority = prio,
+	};
+	int ret;
+
+	ret = sched_setattr_nocheck(st->worker->task, &attr);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(st->rt_priority, prio);
+
+	return 0;
+}
+
+static ssize_t verify_writes_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct ltc5599 *st = iio_priv(dev_to_iio_dev(dev));
+
+	return sysfs_emit(buf, "%d\n", READ_ONCE(st->verify_writes));
+}
+
+/*
+ * Read back every commit in the same SPI message and rewrite registers
+ * that differ. Commits that still do not match fail with -EIO.
+ */
+static ssize_t verify_writes_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct ltc5599 *st = iio_priv(dev_to_iio_dev(dev));
+	bool val;
+	int ret;
+
+	ret = kstrtobool(buf, &val);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(st->verify_writes, val);
+
+	return len;
+}
+
+static ssize_t verify_failures_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct ltc5599 *st = iio_priv(indio_dev);
+	unsigned int val;
+
+	mutex_lock(&indio_dev->mlock);
+	val = st->verify_failures;
+	mutex_unlock(&indio_dev->mlock);
+
+	return sysfs_emit(buf, "%u\n", val);
+}
+
+/* samples the output buffer had to drop, see ltc5599_play_sample() */
+static ssize_t dropped_samples_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct ltc5599 *st = iio_priv(dev_to_iio_dev(dev));
+
+	return sysfs_emit(buf, "%u\n", READ_ONCE(st->trig_dropped));
+}
+
+static ssize_t rt_priority_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct ltc5599 *st = iio_priv(dev_to_iio_dev(dev));
+
+	return sysfs_emit(buf, "%u\n", READ_ONCE(st->rt_priority));
+}
+
+/* SCHED_FIFO priority of the device worker, 0 for SCHED_NORMAL */
+static ssize_t rt_priority_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct ltc5599 *st = iio_priv(dev_to_iio_dev(dev));
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &val);
+	if (ret)
+		return ret;
+	if (val >= MAX_RT_PRIO)
+		return -EINVAL;
+
+	ret = ltc5599_set_rt_priority(st, val);
+
+	return ret ? ret : len;
+}
+
+static ssize_t config_generation_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct ltc5599 *st = iio_priv(dev_to_iio_dev(dev));
+
+	return sysfs_emit(buf, "%u\n", atomic_read(&st->generation));
+}
+
+static ssize_t gang_skew_ns_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct ltc5599 *st = iio_priv(dev_to_iio_dev(dev));
+	s64 val = 0;
+
+	/* remove leaves the gang while this attribute is still readable */
+	mutex_lock(&ltc5599_gangs_lock);
+	if (st->gang) {
+		mutex_lock(&st->gang->lock);
+		val = st->gang->skew_ns;
+		mutex_unlock(&st->gang->lock);
+	}
+	mutex_unlock(&ltc5599_gangs_lock);
+
+	return sysfs_emit(buf, "%lld\n", val);
+}
+
+static ssize_t calibrate_leakage_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct ltc5599 *st = iio_priv(indio_dev);
+	unsigned int iter;
+	int power;
+
+	mutex_lock(&indio_dev->mlock);
+	iter = st->leakage_iter;
+	power = st->leakage_power;
+	mutex_unlock(&indio_dev->mlock);
+
+	return sysfs_emit(buf, "%u %d\n", iter, power);
+}
+
+static ssize_t calibrate_leakage_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	bool val;
+	int ret;
+
+	ret = kstrtobool(buf, &val);
+	if (ret)
+		return ret;
+	if (!val)
+		return len;
+
+	ret = ltc5599_calibrate_leakage(indio_dev);
+	if (ret)
+		return ret;
+
+	return len;
+}
+
+static ssize_t calibrate_image_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct ltc5599 *st = iio_priv(indio_dev);
+	unsigned int iter;
+	int power, gain;
+
+	mutex_lock(&indio_dev->mlock);
+	iter = st->image_iter;
+	power = st->image_power;
+	gain = st->image_gain;
+	mutex_unlock(&indio_dev->mlock);
+
+	return sysfs_emit(buf, "%u %d %d\n", iter, power, gain);
+}
+
+static ssize_t calibrate_image_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	bool val;
+	int ret;
+
+	ret = kstrtobool(buf, &val);
+	if (ret)
+		return ret;
+	if (!val)
+		return len;
+
+	ret = ltc5599_calibrate_image(indio_dev);
+	if (ret)
+		return ret;
+
+	return len;
+}
+
+static ssize_t lo_match_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct ltc5599 *st = iio_priv(dev_to_iio_dev(dev));
+	u8 regs[LTC5599_NUM_REGS];
+
+	ltc5599_snapshot(st, regs);
+
+	return sysfs_emit(buf, "%u\n", regs[LTC5599_LOMATCH_OVR_REG]);
+}
+
+/* set the LO-match override of the current band, -1 drops it */
+static ssize_t lo_match_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct ltc5599 *st = iio_priv(indio_dev);
+	int val, ret;
+
+	ret = kstrtoint(buf, 0, &val);
+	if (ret)
+		return ret;
+
+	mutex_lock(&indio_dev->mlock);
+	ret = __ltc5599_set_lo_match(st,
+		st->shadowregs[LTC5599_FREQ_REG] & LTC5599_FREQ_MASK, val);
+	if (!ret)
+		ret = __ltc5599_refresh_band(indio_dev, LTC5599_SRC_CAL);
+	mutex_unlock(&indio_dev->mlock);
+
+	return ret ? ret : len;
+}
+
+static ssize_t lo_match_table_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct ltc5599 *st = iio_priv(indio_dev);
+	unsigned int band;
+	ssize_t len = 0;
+
+	mutex_lock(&indio_dev->mlock);
+	for (band = 1; band <= LTC5599_NUM_BANDS; band++)
+		if (st->cal[band].valid & LTC5599_CAL_LO_MATCH)
+			len += sysfs_emit_at(buf, len, "%u %u\n", band,
+					     st->cal[band].lo_match);
+	mutex_unlock(&indio_dev->mlock);
+
+	return len;
+}
+
+/* "<band> <value>" sets the override of any band, a value of -1 drops it */
+static ssize_t lo_match_table_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct ltc5599 *st = iio_priv(indio_dev);
+	unsigned int band;
+	int val, ret;
+
+	if (sscanf(buf, "%u %d", &band, &val) != 2)
+		return -EINVAL;
+	if (!band || band > LTC5599_NUM_BANDS)
+		return -EINVAL;
+
+	mutex_lock(&indio_dev->mlock);
+	ret = __ltc5599_set_lo_match(st, band, val);
+	if (!ret)
+		ret = __ltc5599_refresh_band(indio_dev, LTC5599_SRC_CAL);
+	mutex_unlock(&indio_dev->mlock);
+
+	return ret ? ret : len;
+}
+
+static ssize_t ltc5599_show_gain_bit(struct device *dev, char *buf, u8 bit)
+{
+	struct ltc5599 *st = iio_priv(dev_to_iio_dev(dev));
+	u8 regs[LTC5599_NUM_REGS];
+
+	ltc5599_snapshot(st, regs);
+
+	return sysfs_emit(buf, "%d\n", !!(regs[LTC5599_GAIN_REG] & bit));
+}
+
+static ssize_t ltc5599_store_gain_bit(struct device *dev, const char *buf,
+	size_t len, enum ltc5599_param param)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	bool val;
+	int ret;
+
+	ret = kstrtobool(buf, &val);
+	if (ret)
+		return ret;
+
+	ret = ltc5599_apply_one(indio_dev, param, 0, val, LTC5599_SRC_SYSFS);
+
+	return ret ? ret : len;
+}
+
+/* 1 turns the Q channel off, e.g. for single-sideband operation */
+static ssize_t q_disable_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	return ltc5599_show_gain_bit(dev, buf, LTC5599_QDISABLE_BIT);
+}
+
+static ssize_t q_disable_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t len)
+{
+	return ltc5599_store_gain_bit(dev, buf, len, LTC5599_PARAM_QDISABLE);
+}
+
+static ssize_t agc_control_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	return ltc5599_show_gain_bit(dev, buf, LTC5599_AGCTRL_BIT);
+}
+
+static ssize_t agc_control_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t len)
+{
+	return ltc5599_store_gain_bit(dev, buf, len, LTC5599_PARAM_AGCTRL);
+}
+
+/* last and longest time from a runtime resume request to a restored chip */
+static ssize_t resume_latency_ns_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct ltc5599 *st = iio_priv(dev_to_iio_dev(dev));
+
+	return sysfs_emit(buf, "%llu %llu\n", READ_ONCE(st->resume_ns),
+			  READ_ONCE(st->resume_max_ns));
+}
+
+static ssize_t target_level_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct ltc5599 *st = iio_priv(indio_dev);
+	ssize_t ret;
+
+	mutex_lock(&indio_dev->mlock);
+	if (st->level_en)
+		ret = sysfs_emit(buf, "%d\n", st->target_level_mdb);
+	else
+		ret = sysfs_emit(buf, "off\n");
+	mutex_unlock(&indio_dev->mlock);
+
+	return ret;
+}
+
+/*
+ * Output level in milli-dB relative to the nominal output at 0 dB
+ * attenuation. While set, every band change also commits the attenuation
+ * that holds this level according to the flatness table; "off" returns
+ * the gain to manual control.
+ */
+static ssize_t target_level_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct ltc5599 *st = iio_priv(indio_dev);
+	int val, ret;
+
+	if (sysfs_streq(buf, "off")) {
+		mutex_lock(&indio_dev->mlock);
+		st->level_en = false;
+		mutex_unlock(&indio_dev->mlock);
+		return len;
+	}
+
+	ret = kstrtoint(buf, 0, &val);
+	if (ret)
+		return ret;
+	if (abs(val) > LTC5599_FLATNESS_MAX_MDB + LTC5599_GAIN_MAX_ATTEN * 1000)
+		return -EINVAL;
+
+	mutex_lock(&indio_dev->mlock);
+	st->level_en = true;
+	st->target_level_mdb = val;
+	ret = __ltc5599_refresh_band(indio_dev, LTC5599_SRC_SYSFS);
+	mutex_unlock(&indio_dev->mlock);
+
+	return ret ? ret : len;
+}
+
+static ssize_t gain_flatness_table_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct ltc5599 *st = iio_priv(indio_dev);
+	unsigned int band;
+	ssize_t len = 0;
+
+	mutex_lock(&indio_dev->mlock);
+	for (band = 1; band <= LTC5599_NUM_BANDS; band++)
+		if (st->cal[band].flatness_mdb)
+			len += sysfs_emit_at(buf, len, "%u %d\n", band,
+					     st->cal[band].flatness_mdb);
+	mutex_unlock(&indio_dev->mlock);
+
+	return len;
+}
+
+/* "<band> <milli-dB>" sets the output level deviation of one band */
+static ssize_t gain_flatness_table_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct ltc5599 *st = iio_priv(indio_dev);
+	unsigned int band;
+	int val, ret;
+
+	if (sscanf(buf, "%u %d", &band, &val) != 2)
+		return -EINVAL;
+	if (!band || band > LTC5599_NUM_BANDS)
+		return -EINVAL;
+
+	mutex_lock(&indio_dev->mlock);
+	ret = __ltc5599_set_flatness(st, band, val);
+	if (!ret)
+		ret = __ltc5599_refresh_band(indio_dev, LTC5599_SRC_CAL);
+	mutex_unlock(&indio_dev->mlock);
+
+	return ret ? ret : len;
+}
+
+/*
+ * Drop the calibrated offset and IQ corrections of all bands. LO-match
+ * overrides and the flatness table are settings rather than calibration
+ * results and stay. The current band goes back to neutral corrections
+ * where it had calibrated ones.
+ */
+static ssize_t calibration_clear_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct ltc5599 *st = iio_priv(indio_dev);
+	u8 regs[LTC5599_NUM_REGS];
+	unsigned int band;
+	bool val;
+	int ret;
+
+	ret = kstrtobool(buf, &val);
+	if (ret)
+		return ret;
+	if (!val)
+		return len;
+
+	mutex_lock(&indio_dev->mlock);
+	memcpy(regs, st->shadowregs, sizeof(regs));
+	band = regs[LTC5599_FREQ_REG] & LTC5599_FREQ_MASK;
+	if (band <= LTC5599_NUM_BANDS) {
+		if (st->cal[band].valid & LTC5599_CAL_OFFSET) {
+			ltc5599_encode_offset(regs, 0, 0);
+			ltc5599_encode_offset(regs, 1, 0);
+		}
+		if (st->cal[band].valid & LTC5599_CAL_IQ) {
+			ltc5599_encode_iqgainratio(regs, 0);
+			ltc5599_encode_iqphasebalance(regs, 0);
+		}
+	}
+
+	for (band = 0; band <= LTC5599_NUM_BANDS; band++)
+		st->cal[band].valid &= ~(LTC5599_CAL_OFFSET | LTC5599_CAL_IQ);
+
+	ret = ltc5599_encode_band(st, regs, regs[LTC5599_FREQ_REG] & LTC5599_FREQ_MASK);
+	if (!ret)
+		ret = __ltc5599_commit(indio_dev, regs, LTC5599_SRC_CAL);
+	mutex_unlock(&indio_dev->mlock);
+
+	return ret < 0 ? ret : len;
+}
+
+static IIO_DEVICE_ATTR_WO(recover, 0);
+static IIO_DEVICE_ATTR_RW(scrub_interval_ms, 0);
+static IIO_DEVICE_ATTR_RO(scrub_recoveries, 0);
+static IIO_DEVICE_ATTR_RW(temp_threshold, 0);
+static IIO_DEVICE_ATTR_RO(temp_corrections, 0);
+static IIO_DEVICE_ATTR_RO(spi_speed_hz, 0);
+static IIO_DEVICE_ATTR_RO(spi_tune_errors, 0);
+static IIO_DEVICE_ATTR_RW(verify_writes, 0);
+static IIO_DEVICE_ATTR_RO(verify_failures, 0);
+static IIO_DEVICE_ATTR_RO(dropped_samples, 0);
+static IIO_DEVICE_ATTR_RW(rt_priority, 0);
+static IIO_DEVICE_ATTR_RO(config_generation, 0);
+static IIO_DEVICE_ATTR_RO(gang_skew_ns, 0);
+static IIO_DEVICE_ATTR_RW(calibrate_leakage, 0);
+static IIO_DEVICE_ATTR_RW(calibrate_image, 0);
+static IIO_DEVICE_ATTR_RW(lo_match, 0);
+static IIO_DEVICE_ATTR_RW(lo_match_table, 0);
+static IIO_DEVICE_ATTR_RW(target_level, 0);
+static IIO_DEVICE_ATTR_RW(q_disable, 0);
+static IIO_DEVICE_ATTR_RW(agc_control, 0);
+static IIO_DEVICE_ATTR_RO(resume_latency_ns, 0);
+static IIO_DEVICE_ATTR_RW(gain_flatness_table, 0);
+static IIO_DEVICE_ATTR_WO(calibration_clear, 0);
+
+static struct attribute *ltc5599_attributes[] = {
+	&iio_dev_attr_recover.dev_attr.attr,
+	&iio_dev_attr_scrub_interval_ms.dev_attr.attr,
+	&iio_dev_attr_scrub_recoveries.dev_attr.attr,
+	&iio_dev_attr_temp_threshold.dev_attr.attr,
+	&iio_dev_attr_temp_corrections.dev_attr.attr,
+	&iio_dev_attr_spi_speed_hz.dev_attr.attr,
+	&iio_dev_attr_spi_tune_errors.dev_attr.attr,
+	&iio_dev_attr_verify_writes.dev_attr.attr,
+	&iio_dev_attr_verify_failures.dev_attr.attr,
+	&iio_dev_attr_dropped_samples.dev_attr.attr,
+	&iio_dev_attr_rt_priority.dev_attr.attr,
+	&iio_dev_attr_config_generation.dev_attr.attr,
+	&iio_dev_attr_gang_skew_ns.dev_attr.attr,
+	&iio_dev_attr_calibrate_leakage.dev_attr.attr,
+	&iio_dev_attr_calibrate_image.dev_attr.attr,
+	&iio_dev_attr_lo_match.dev_attr.attr,
+	&iio_dev_attr_lo_match_table.dev_attr.attr,
+	&iio_dev_attr_target_level.dev_attr.attr,
+	&iio_dev_attr_q_disable.dev_attr.attr,
+	&iio_dev_attr_agc_control.dev_attr.attr,
+	&iio_dev_attr_resume_latency_ns.dev_attr.attr,
+	&iio_dev_attr_gain_flatness_table.dev_attr.attr,
+	&iio_dev_attr_calibration_clear.dev_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group ltc5599_attribute_group = {
+	.attrs = ltc5599_attributes,
+};
+
+/*
+ * Copy change log entry seq to e. Returns false if it has been overwritten
+ * before or while copying.
+ */
+static bool ltc5599_log_copy(struct ltc5599 *st, u32 seq,
+	struct ltc5599_change *e)
+{
+	struct ltc5599_change *slot = &st->log[seq % LTC5599_LOG_ENTRIES];
+
+	if (smp_load_acquire(&slot->seq) != seq)
+		return false;
+	memcpy(e, slot, sizeof(*e));
+	smp_rmb();
+
+	return READ_ONCE(slot->seq) == seq;
+}
+
+/* readers start at the oldest entry still in the log */
+static int ltc5599_log_open(struct inode *inode, struct file *file)
+{
+	struct ltc5599 *st = inode->i_private;
+	u32 head = smp_load_acquire(&st->log_head);
+
+	file->private_data = st;
+	file->f_pos = head > LTC5599_LOG_ENTRIES ?
+		(loff_t)(head - LTC5599_LOG_ENTRIES) * sizeof(struct ltc5599_change) : 0;
+
+	return nonseekable_open(inode, file);
+}
+
+/*
+ * Return as many whole entries as fit into the buffer, 0 once the reader
+ * has caught up. Entries overwritten before they could be read are
+ * skipped and counted in log_overflow.
+ */
+static ssize_t ltc5599_log_read(struct file *file, char __user *buf,
+	size_t len, loff_t *ppos)
+{
+	struct ltc5599 *st = file->private_data;
+	struct ltc5599_change e;
+	u32 seq, start, head;
+	size_t done = 0;
+
+	start = seq = div_u64(*ppos, sizeof(e));
+	head = smp_load_acquire(&st->log_head);
+	if (head - seq > LTC5599_LOG_ENTRIES) {
+		atomic_add(head - seq - LTC5599_LOG_ENTRIES, &st->log_overflow);
+		seq = head - LTC5599_LOG_ENTRIES;
+	}
+
+	for (; seq != head && len - done >= sizeof(e); seq++) {
+		if (!ltc5599_log_copy(st, seq, &e)) {
+			atomic_inc(&st->log_overflow);
+			continue;
+		}
+		if (copy_to_user(buf + done, &e, sizeof(e))) {
+			if (!done)
+				return -EFAULT;
+			break;
+		}
+		done += sizeof(e);
+	}
+
+	*ppos += (loff_t)(seq - start) * sizeof(e);
+
+	return done;
+}
+
+static const struct file_operations ltc5599_log_fops = {
+	.owner = THIS_MODULE,
+	.open = ltc5599_log_open,
+	.read = ltc5599_log_read,
+	.llseek = no_llseek,
+};
+
+static int ltc5599_setup_log(struct ltc5599 *st)
+{
+	st->log = devm_kcalloc(&st->spi->dev, LTC5599_LOG_ENTRIES,
+			       sizeof(*st->log), GFP_KERNEL);
+	if (!st->log)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static void ltc5599_log_debugfs_init(struct iio_dev *indio_dev)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+	struct dentry *d = iio_get_debugfs_dentry(indio_dev);
+
+	if (!d)
+		return;
+
+	debugfs_create_file("change_log", 0400, d, st, &ltc5599_log_fops);
+	debugfs_create_atomic_t("change_log_overflow", 0400, d,
+				&st->log_overflow);
+}
+
+static int ltc5599_reg_access(struct iio_dev *indio_dev, unsigned int reg,
+	unsigned int writeval, unsigned int *readval)
+{
+	u8 tmp;
+	int ret;
+
+	if (reg >= LTC5599_NUM_REGS)
+		return -EINVAL;
+
+	if (readval) {
+		ret = ltc5599_read(indio_dev, reg, &tmp);
+		if (ret)
+			return ret;
+		*readval = tmp;
+		return 0;
+	}
+
+	return ltc5599_apply_one(indio_dev, LTC5599_PARAM_REG, reg, writeval,
+				 LTC5599_SRC_SYSFS);
+}
+
+static const struct iio_info ltc5599_info = {
+	.read_raw = ltc5599_read_raw,
+	.write_raw = ltc5599_write_raw,
+	.read_avail = ltc5599_read_avail,
+	.read_label = ltc5599_read_label,
+	.debugfs_reg_access = ltc5599_reg_access,
+	.attrs = &ltc5599_attribute_group,
+};
+
+static const struct iio_event_spec ltc5599_events[] = {
+	{
+		.type = IIO_EV_TYPE_CHANGE,
+		.dir = IIO_EV_DIR_NONE,
+	},
+};
+
+/**
+ * ltc5599_apply() - reconfigure the modulator from another kernel driver
+ * @chan:	any channel of the LTC5599, as returned by iio_channel_get()
+ * @updates:	parameter updates, applied in order
+ * @count:	number of entries in @updates
+ *
+ * All updates are committed to the chip in a single SPI burst. Nothing is
+ * written if one of them is out of range.
+ *
+ * Context: process context, may sleep.
+ * Return: 0 on success, negative error code otherwise.
+ */
+int ltc5599_apply(struct iio_channel *chan,
+	const struct ltc5599_update *updates, unsigned int count)
+{
+	/*
+	 * The channel holds a reference on the IIO device, so ->info can be
+	 * read; it only tells the device apart from other IIO drivers. A
+	 * device being removed is caught by the st->removed check made under
+	 * mlock in ltc5599_apply_updates().
+	 */
+	if (!chan || chan->indio_dev->info != &ltc5599_info)
+		return -ENODEV;
+
+	return ltc5599_apply_updates(chan->indio_dev, updates, count,
+				     LTC5599_SRC_KERNEL);
+}
+EXPORT_SYMBOL_GPL(ltc5599_apply);
+
+/**
+ * ltc5599_gang_apply() - reconfigure all modulators of a gang
+ * @chan:	any channel of any LTC5599 in the gang
+ * @updates:	parameter updates, applied in order to every member
+ * @count:	number of entries in @updates
+ *
+ * Like ltc5599_apply(), but for every device sharing the adi,gang-id of
+ * the device behind @chan. Devices that are not in a gang are updated on
+ * their own.
+ *
+ * Context: process context, may sleep.
+ * Return: 0 on success, negative error code otherwise.
+ */
+int ltc5599_gang_apply(struct iio_channel *chan,
+	const struct ltc5599_update *updates, unsigned int count)
+{
+	/* see ltc5599_apply(); a removed device has already left its gang */
+	if (!chan || chan->indio_dev->info != &ltc5599_info)
+		return -ENODEV;
+
+	return ltc5599_gang_apply_updates(iio_priv(chan->indio_dev), updates,
+					  count, LTC5599_SRC_KERNEL);
+}
+EXPORT_SYMBOL_GPL(ltc5599_gang_apply);
+
+static bool chardev;
+module_param(chardev, bool, 0444);
+MODULE_PARM_DESC(chardev, "Create a /dev/ltc5599-* batch ioctl device per chip");
+
+static void ltc5599_ring_release(struct kref *ref)
+{
+	struct ltc5599 *st = container_of(ref, struct ltc5599, ring_ref);
+
+	vfree(st->ring);
+}
+
+/*
+ * An open file keeps the device state and the ring alive past removal;
+ * misc_deregister() serialises against open, so no file gets opened once
+ * the device has dropped its ring reference.
+ */
+static int ltc5599_cdev_open(struct inode *inode, struct file *file)
+{
+	struct ltc5599 *st = container_of(file->private_data,
+					  struct ltc5599, miscdev);
+
+	iio_device_get(st->indio_dev);
+	kref_get(&st->ring_ref);
+
+	return nonseekable_open(inode, file);
+}
+
+static int ltc5599_cdev_release(struct inode *inode, struct file *file)
+{
+	struct ltc5599 *st = container_of(file->private_data,
+					  struct ltc5599, miscdev);
+
+	kref_put(&st->ring_ref, ltc5599_ring_release);
+	iio_device_put(st->indio_dev);
+
+	return 0;
+}
+
+static void ltc5599_op_to_update(const struct ltc5599_op *op,
+	struct ltc5599_update *upd)
+{
+	upd->param = op->param;
+	upd->index = op->index;
+	upd->value = op->value;
+}
+
+static long ltc5599_ioctl_apply(struct ltc5599 *st, void __user *arg)
+{
+	struct iio_dev *indio_dev = st->indio_dev;
+	struct ltc5599_update *upd;
+	struct ltc5599_batch batch;
+	struct ltc5599_op *ops;
+	unsigned int i;
+	int ret;
+
+	if (copy_from_user(&batch, arg, sizeof(batch)))
+		return -EFAULT;
+	if (!batch.count || batch.count > LTC5599_MAX_OPS || batch.flags)
+		return -EINVAL;
+
+	ops = memdup_user(u64_to_user_ptr(batch.ops),
+			  batch.count * sizeof(*ops));
+	if (IS_ERR(ops))
+		return PTR_ERR(ops);
+
+	upd = kcalloc(batch.count, sizeof(*upd), GFP_KERNEL);
+	if (!upd) {
+		kfree(ops);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < batch.count; i++)
+		ltc5599_op_to_update(&ops[i], &upd[i]);
+
+	mutex_lock(&indio_dev->mlock);
+	if (st->removed)
+		ret = -ENODEV;
+	else
+		ret = __ltc5599_apply(indio_dev, upd, batch.count,
+				      LTC5599_SRC_IOCTL);
+	mutex_unlock(&indio_dev->mlock);
+
+	kfree(upd);
+	kfree(ops);
+
+	return ret;
+}
+
+static long ltc5599_ioctl_get_state(struct ltc5599 *st, void __user *arg)
+{
+	struct ltc5599_state state = {};
+	u8 *regs = state.regs;
+
+	ltc5599_snapshot(st, regs);
+
+	state.generation = atomic_read(&st->generation);
+	state.frequency = ctrl_word_to_freq(regs[LTC5599_FREQ_REG] & LTC5599_FREQ_MASK);
+	state.hardwaregain = -(int)(regs[LTC5599_GAIN_REG] & LTC5599_GAIN_MASK);
+	state.offset[0] = regs[LTC5599_OFFSI_REG] - 128;
+	state.offset[1] = regs[LTC5599_OFFSQ_REG] - 128;
+	state.quadrature_correction = regs[LTC5599_IQ_GAINRAT_REG] - 128;
+	state.phase = ltc5599_decode_iqphasebalance(regs);
+
+	if (copy_to_user(arg, &state, sizeof(state)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static long ltc5599_cdev_ioctl(struct file *file, unsigned int cmd,
+	unsigned long arg)
+{
+	struct ltc5599 *st = container_of(file->private_data,
+					  struct ltc5599, miscdev);
+	void __user *argp = (void __user *)arg;
+
+	if (READ_ONCE(st->removed))
+		return -ENODEV;
+
+	switch (cmd) {
+	case LTC5599_IOC_APPLY:
+		return ltc5599_ioctl_apply(st, argp);
+	case LTC5599_IOC_GET_STATE:
+		return ltc5599_ioctl_get_state(st, argp);
+	case LTC5599_IOC_DOORBELL:
+		mutex_lock(&st->indio_dev->mlock);
+		if (!st->removed)
+			kthread_queue_work(st->worker, &st->ring_work);
+		mutex_unlock(&st->indio_dev->mlock);
+		return 0;
+	default:
+		return -ENOTTY;
+	}
+}
+
+static struct ltc5599_ring_ctrl *ltc5599_ring_ctrl(struct ltc5599 *st)
+{
+	return st->ring;
+}
+
+static struct ltc5599_cmd *ltc5599_ring_cmd(struct ltc5599 *st, u32 idx)
+{
+	struct ltc5599_cmd *sq = st->ring + LTC5599_RING_SQ_OFFSET;
+
+	return &sq[idx % LTC5599_RING_ENTRIES];
+}
+
+static bool ltc5599_ring_pending(struct ltc5599 *st)
+{
+	return smp_load_acquire(&ltc5599_ring_ctrl(st)->sq_head) != st->ring_tail;
+}
+
+static void ltc5599_ring_post(struct ltc5599 *st,
+	const struct ltc5599_completion *c)
+{
+	struct ltc5599_ring_ctrl *ctrl = ltc5599_ring_ctrl(st);
+	struct ltc5599_completion *cq = st->ring + LTC5599_RING_CQ_OFFSET;
+	u32 head = ctrl->cq_head;
+
+	if (head - READ_ONCE(ctrl->cq_tail) >= LTC5599_RING_ENTRIES) {
+		WRITE_ONCE(ctrl->cq_overflow, ctrl->cq_overflow + 1);
+		return;
+	}
+
+	cq[head % LTC5599_RING_ENTRIES] = *c;
+	smp_store_release(&ctrl->cq_head, head + 1);
+}
+
+/*
+ * Commit the image accumulated from n commands and post their completions.
+ * Caller must hold indio_dev->mlock.
+ */
+static void ltc5599_ring_flush(struct ltc5599 *st, const u8 *regs,
+	unsigned int n)
+{
+	unsigned int i;
+	u64 timestamp;
+	int ret;
+
+	ret = __ltc5599_commit(st->indio_dev, regs, LTC5599_SRC_RING);
+	timestamp = ktime_get_ns();
+
+	for (i = 0; i < n; i++) {
+		if (!st->ring_batch[i].status && ret < 0)
+			st->ring_batch[i].status = ret;
+		st->ring_batch[i].timestamp_ns = timestamp;
+		ltc5599_ring_post(st, &st->ring_batch[i]);
+	}
+
+	wake_up(&st->ring_cq_wq);
+}
+
+/*
+ * Consume all queued commands. Consecutive commands are merged into one
+ * register image and committed in a single burst; a command with a
+ * deadline in the future closes the current burst and is left queued,
+ * with st->ring_timer set to pick it up at the deadline. The worker does
+ * not wait for it, so the other background work keeps running. Commands
+ * with invalid updates or a deadline more than LTC5599_CMD_MAX_DELAY_NS
+ * ahead complete with an error and leave the image untouched.
+ * Returns true if a deadline is pending.
+ */
+static bool ltc5599_ring_process(struct ltc5599 *st)
+{
+	struct ltc5599_ring_ctrl *ctrl = ltc5599_ring_ctrl(st);
+	struct iio_dev *indio_dev = st->indio_dev;
+	u8 regs[LTC5599_NUM_REGS], tmp[LTC5599_NUM_REGS];
+	struct ltc5599_update upd;
+	struct ltc5599_cmd cmd;
+	unsigned int n = 0, i;
+	bool waiting = false;
+	ktime_t deadline, now;
+	u32 head;
+	int ret;
+
+	head = smp_load_acquire(&ctrl->sq_head);
+	if (head - st->ring_tail > LTC5599_RING_ENTRIES)
+		head = st->ring_tail + LTC5599_RING_ENTRIES;
+
+	mutex_lock(&indio_dev->mlock);
+	memcpy(regs, st->shadowregs, LTC5599_NUM_REGS);
+
+	while (st->ring_tail != head && !st->removed) {
+		memcpy(&cmd, ltc5599_ring_cmd(st, st->ring_tail), sizeof(cmd));
+
+		ret = cmd.count > LTC5599_CMD_MAX_OPS ? -EINVAL : 0;
+		if (cmd.flags & LTC5599_CMD_DEADLINE) {
+			deadline = ns_to_ktime(cmd.deadline_ns);
+			now = ktime_get();
+			if (ktime_after(deadline,
+					ktime_add_ns(now, LTC5599_CMD_MAX_DELAY_NS))) {
+				ret = -EINVAL;
+			} else if (ktime_after(deadline, now)) {
+				hrtimer_start(&st->ring_timer, deadline,
+					      HRTIMER_MODE_ABS);
+				waiting = true;
+				break;
+			}
+		}
+
+		smp_store_release(&ctrl->sq_tail, ++st->ring_tail);
+
+		memcpy(tmp, regs, LTC5599_NUM_REGS);
+		for (i = 0; i < cmd.count && !ret; i++) {
+			ltc5599_op_to_update(&cmd.ops[i], &upd);
+			ret = ltc5599_encode_update(st, tmp, &upd);
+		}
+		if (!ret)
+			memcpy(regs, tmp, LTC5599_NUM_REGS);
+
+		st->ring_batch[n].seq = cmd.seq;
+		st->ring_batch[n].status = ret;
+		n++;
+	}
+
+	if (n)
+		ltc5599_ring_flush(st, regs, n);
+	mutex_unlock(&indio_dev->mlock);
+
+	return waiting;
+}
+
+/*
+ * Queued by the doorbell and by the deadline timer. Only returns once the
+ * ring is empty with consumer_idle set, or with a deadline pending and
+ * consumer_idle clear, so a producer that found the consumer busy can
+ * rely on its commands being picked up without ringing.
+ */
+static void ltc5599_ring_work(struct kthread_work *work)
+{
+	struct ltc5599 *st = container_of(work, struct ltc5599, ring_work);
+	struct ltc5599_ring_ctrl *ctrl = ltc5599_ring_ctrl(st);
+
+	do {
+		WRITE_ONCE(ctrl->consumer_idle, 0);
+		if (ltc5599_ring_process(st))
+			return;
+
+		/* pairs with the producer reading consumer_idle after sq_head */
+		WRITE_ONCE(ctrl->consumer_idle, 1);
+		smp_mb();
+	} while (ltc5599_ring_pending(st) && !READ_ONCE(st->removed));
+}
+
+static enum hrtimer_restart ltc5599_ring_timer(struct hrtimer *timer)
+{
+	struct ltc5599 *st = container_of(timer, struct ltc5599, ring_timer);
+
+	kthread_queue_work(st->worker, &st->ring_work);
+
+	return HRTIMER_NORESTART;
+}
+
+static __poll_t ltc5599_cdev_poll(struct file *file, poll_table *wait)
+{
+	struct ltc5599 *st = container_of(file->private_data,
+					  struct ltc5599, miscdev);
+	struct ltc5599_ring_ctrl *ctrl = ltc5599_ring_ctrl(st);
+
+	poll_wait(file, &st->ring_cq_wq, wait);
+
+	if (READ_ONCE(st->removed))
+		return EPOLLERR;
+
+	if (READ_ONCE(ctrl->cq_head) != READ_ONCE(ctrl->cq_tail))
+		return EPOLLIN | EPOLLRDNORM;
+
+	return 0;
+}
+
+static int ltc5599_cdev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct ltc5599 *st = container_of(file->private_data,
+					  struct ltc5599, miscdev);
+
+	if (READ_ONCE(st->removed))
+		return -ENODEV;
+
+	if (vma->vm_pgoff ||
+	    vma->vm_end - vma->vm_start > PAGE_ALIGN(LTC5599_RING_SIZE))
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, st->ring, 0);
+}
+
+static const struct file_operations ltc5599_cdev_fops = {
+	.owner = THIS_MODULE,
+	.open = ltc5599_cdev_open,
+	.release = ltc5599_cdev_release,
+	.unlocked_ioctl = ltc5599_cdev_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.poll = ltc5599_cdev_poll,
+	.mmap = ltc5599_cdev_mmap,
+	.llseek = no_llseek,
+};
+
+/* the ring itself goes with the last open file */
+static void ltc5599_ring_free(void *data)
+{
+	struct ltc5599 *st = data;
+
+	hrtimer_cancel(&st->ring_timer);
+	kthread_cancel_work_sync(&st->ring_work);
+	kref_put(&st->ring_ref, ltc5599_ring_release);
+}
+
+static int ltc5599_setup_ring(struct ltc5599 *st)
+{
+	struct device *dev = &st->spi->dev;
+	int ret;
+
+	hrtimer_init(&st->ring_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	st->ring_timer.function = ltc5599_ring_timer;
+	init_waitqueue_head(&st->ring_cq_wq);
+	kthread_init_work(&st->ring_work, ltc5599_ring_work);
 
-		ret = ltc5599_write_freq(indio_dev, tmp);
-		break;
-	case IIO_CHAN_INFO_HARDWAREGAIN:
-		if (val > 0)
-			return -EINVAL;
-		tmp = -val;
-		if (tmp > 19)
-			tmp = 19;
+	st->ring_batch = devm_kcalloc(dev, LTC5599_RING_ENTRIES,
+				      sizeof(*st->ring_batch), GFP_KERNEL);
+	if (!st->ring_batch)
+		return -ENOMEM;
 
-		ret = ltc5599_write_gain(indio_dev, tmp);
-		break;
-	case IIO_CHAN_INFO_QUADRATURE_CORRECTION_RAW:
-		if ((val < -127) || (val > 127))
-			return -EINVAL;
-		ret = ltc5599_write_iqgainratio(indio_dev, val);
-		break;
-	case IIO_CHAN_INFO_PHASE:
-		if ((val < -240) || (val > 239))
-			return -EINVAL;
-		ret = ltc5599_write_iqphasebalance(indio_dev, val);
-		break;
-	default:
-		ret = -EINVAL;
+	st->ring = vmalloc_user(PAGE_ALIGN(LTC5599_RING_SIZE));
+	if (!st->ring)
+		return -ENOMEM;
+
+	ltc5599_ring_ctrl(st)->consumer_idle = 1;
+	kref_init(&st->ring_ref);
+
+	return devm_add_action_or_reset(dev, ltc5599_ring_free, st);
+}
+
+static int ltc5599_setup_cdev(struct ltc5599 *st)
+{
+	struct device *dev = &st->spi->dev;
+	int ret;
+
+	if (!chardev)
+		return 0;
+
+	ret = ltc5599_setup_ring(st);
+	if (ret)
+		return ret;
+
+	st->miscdev.minor = MISC_DYNAMIC_MINOR;
+	st->miscdev.name = devm_kasprintf(dev, GFP_KERNEL, "ltc5599-%s",
+					  dev_name(dev));
+	if (!st->miscdev.name)
+		return -ENOMEM;
+	st->miscdev.fops = &ltc5599_cdev_fops;
+	st->miscdev.parent = dev;
+
+	return misc_register(&st->miscdev);
+}
+
+/* parameter each scan element drives, see enum ltc5599_scan */
+static const struct ltc5599_update ltc5599_scan_updates[LTC5599_SCAN_NUM] = {
+	[LTC5599_SCAN_OFFSET_I] = { LTC5599_PARAM_OFFSET, 0 },
+	[LTC5599_SCAN_OFFSET_Q] = { LTC5599_PARAM_OFFSET, 1 },
+	[LTC5599_SCAN_HARDWAREGAIN] = { LTC5599_PARAM_HARDWAREGAIN },
+	[LTC5599_SCAN_QUADRATURE_CORRECTION] = { LTC5599_PARAM_QUADRATURE_CORRECTION },
+	[LTC5599_SCAN_PHASE] = { LTC5599_PARAM_PHASE },
+};
+
+/*
+ * Commit all enabled scan elements of st->sample together in one burst.
+ * The IIO core holds mlock across a buffer disable while it waits for the
+ * trigger handler and, through postdisable, for st->trig_work, so this
+ * must never block on mlock: a sample that meets a concurrent change or
+ * the disable is dropped.
+ */
+static void ltc5599_play_sample(struct ltc5599 *st)
+{
+	struct iio_dev *indio_dev = st->indio_dev;
+	struct ltc5599_update upd[LTC5599_SCAN_NUM];
+	unsigned int n = 0;
+	int bit, ret;
+
+	for_each_set_bit(bit, indio_dev->active_scan_mask, indio_dev->masklength) {
+		upd[n] = ltc5599_scan_updates[bit];
+		upd[n].value = st->sample[n];
+		n++;
 	}
 
-	return ret;
+	if (!mutex_trylock(&indio_dev->mlock)) {
+		WRITE_ONCE(st->trig_dropped, st->trig_dropped + 1);
+		return;
+	}
+	ret = __ltc5599_apply(indio_dev, upd, n, LTC5599_SRC_TRIGGER);
+	mutex_unlock(&indio_dev->mlock);
+
+	if (ret)
+		dev_warn_ratelimited(&st->spi->dev,
+				     "failed to play out sample: %d\n", ret);
 }
 
-static const struct iio_info ltc5599_info = {
-	.read_raw = ltc5599_read_raw,
-	.write_raw = ltc5599_write_raw,
+/*
+ * The trigger stays busy until the sample has been played out, so
+ * st->sample is not overwritten while the work is pending.
+ */
+static void ltc5599_trig_work(struct kthread_work *work)
+{
+	struct ltc5599 *st = container_of(work, struct ltc5599, trig_work);
+
+	ltc5599_play_sample(st);
+	iio_trigger_notify_done(st->indio_dev->trig);
+}
+
+/*
+ * Play out one sample of the output buffer per trigger, on the real-time
+ * worker if there is one.
+ */
+static irqreturn_t ltc5599_trigger_handler(int irq, void *p)
+{
+	struct iio_poll_func *pf = p;
+	struct iio_dev *indio_dev = pf->indio_dev;
+	struct ltc5599 *st = iio_priv(indio_dev);
+	int ret;
+
+	ret = iio_pop_from_buffer(indio_dev->buffer, st->sample);
+	if (ret)
+		goto out;
+
+	if (READ_ONCE(st->rt_priority)) {
+		kthread_queue_work(st->worker, &st->trig_work);
+		return IRQ_HANDLED;
+	}
+
+	ltc5599_play_sample(st);
+
+out:
+	iio_trigger_notify_done(indio_dev->trig);
+
+	return IRQ_HANDLED;
+}
+
+/*
+ * The trigger is detached by now, wait for a sample still being played
+ * out. Called with mlock held, which the work only ever tries to take.
+ */
+static int ltc5599_buffer_postdisable(struct iio_dev *indio_dev)
+{
+	struct ltc5599 *st = iio_priv(indio_dev);
+
+	kthread_flush_work(&st->trig_work);
+
+	return 0;
+}
+
+static const struct iio_buffer_setup_ops ltc5599_buffer_setup_ops = {
+	.postdisable = ltc5599_buffer_postdisable,
 };
 
+#define LTC5599_SCAN_TYPE {					\
+	.sign = 's',						\
+	.realbits = 16,						\
+	.storagebits = 16,					\
+	.endianness = IIO_CPU,					\
+}
+
 #define LTC5599_CHANNEL(chan) {				\
 	.type = IIO_ALTVOLTAGE,					\
 	.indexed = 1,						\
@@ -721,19 +3859,113 @@ static const struct iio_info ltc5599_info = {
 	.address = (chan),					\
 	.info_mask_separate = BIT(IIO_CHAN_INFO_OFFSET),			\
 	.info_mask_shared_by_type = BIT(IIO_CHAN_INFO_QUADRATURE_CORRECTION_RAW) | BIT(IIO_CHAN_INFO_PHASE) | BIT(IIO_CHAN_INFO_FREQUENCY) | BIT(IIO_CHAN_INFO_HARDWAREGAIN),			\
+	.info_mask_separate_available = BIT(IIO_CHAN_INFO_OFFSET),	\
+	.info_mask_shared_by_type_available = BIT(IIO_CHAN_INFO_QUADRATURE_CORRECTION_RAW) | BIT(IIO_CHAN_INFO_PHASE) | BIT(IIO_CHAN_INFO_FREQUENCY) | BIT(IIO_CHAN_INFO_HARDWAREGAIN),	\
+	.ext_info = ltc5599_ext_info,				\
+	.event_spec = ltc5599_events,				\
+	.num_event_specs = ARRAY_SIZE(ltc5599_events),		\
+	.scan_index = LTC5599_SCAN_OFFSET_I + (chan),		\
+	.scan_type = LTC5599_SCAN_TYPE,				\
+}
+
+/*
+ * Buffer-only channels for the parameters shared by I and Q, numbered
+ * after their scan index; their label names the parameter.
+ */
+#define LTC5599_SCAN_CHANNEL(_index) {				\
+	.type = IIO_ALTVOLTAGE,					\
+	.indexed = 1,						\
+	.output = 1,						\
+	.channel = (_index),					\
+	.scan_index = (_index),					\
+	.scan_type = LTC5599_SCAN_TYPE,				\
 }
 
 static const struct iio_chan_spec ltc5599_channels[] = { \
 	LTC5599_CHANNEL(0), \
 	LTC5599_CHANNEL(1), \
+	LTC5599_SCAN_CHANNEL(LTC5599_SCAN_HARDWAREGAIN), \
+	LTC5599_SCAN_CHANNEL(LTC5599_SCAN_QUADRATURE_CORRECTION), \
+	LTC5599_SCAN_CHANNEL(LTC5599_SCAN_PHASE), \
 };
 
 static const struct ltc5599_chip_info ltc5599_chip_info[] = {
 	[ID_LTC5599] = {
 		.channels = ltc5599_channels,
+		.num_channels = ARRAY_SIZE(ltc5599_channels),
 	},
 };
 
+static void ltc5599_worker_destroy(void *data)
+{
+	kthread_destroy_worker(data);
+}
+
+/*
+ * Every device owns a worker for its background bus traffic. With
+ * adi,rt-priority it runs SCHED_FIFO and triggered samples are played out
+ * on it too, so their latency does not depend on the scheduling of the
+ * trigger source. adi,rt-cpu binds it to one, preferably isolated, CPU.
+ */
+static int ltc5599_setup_worker(struct ltc5599 *st)
+{
+	struct device *dev = &st->spi->dev;
+	u32 cpu, prio = 0;
+	int ret;
+
+	device_property_read_u32(dev, "adi,rt-priority", &prio);
+	if (prio >= MAX_RT_PRIO) {
+		dev_err(dev, "invalid adi,rt-priority\n");
+		return -EINVAL;
+	}
+
+	if (device_property_read_u32(dev, "adi,rt-cpu", &cpu)) {
+		st->worker = kthread_create_worker(0, "ltc5599-%s", dev_name(dev));
+	} else if (cpu < nr_cpu_ids && cpu_possible(cpu)) {
+		st->worker = kthread_create_worker_on_cpu(cpu, 0, "ltc5599-%s",
+							  dev_name(dev));
+	} else {
+		dev_err(dev, "invalid adi,rt-cpu\n");
+		return -EINVAL;
+	}
+	if (IS_ERR(st->worker))
+		return PTR_ERR(st->worker);
+
+	ret = devm_add_action_or_reset(dev, ltc5599_worker_destroy, st->worker);
+	if (ret)
+		return ret;
+
+	kthread_init_work(&st->trig_work, ltc5599_trig_work);
+
+	return prio ? ltc5599_set_rt_priority(st, prio) : 0;
+}
+
+/*
+ * With an enable pin the chip is powered down after
+ * LTC5599_AUTOSUSPEND_MS without bus traffic; power/autosuspend_delay_ms
+ * changes the idle period.
+ */
+static int ltc5599_setup_pm(struct ltc5599 *st)
+{
+	struct device *dev = &st->spi->dev;
+	int ret;
+
+	if (!st->enable_gpio)
+		return 0;
+
+	pm_runtime_set_autosuspend_delay(dev, LTC5599_AUTOSUSPEND_MS);
+	pm_runtime_use_autosuspend(dev);
+	pm_runtime_set_active(dev);
+	ret = devm_pm_runtime_enable(dev);
+	if (ret)
+		return ret;
+
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_idle(dev);
+
+	return 0;
+}
+
 static int ltc5599_spi_probe(struct spi_device *spi)
 {
 	const struct spi_device_id *id = spi_get_device_id(spi);
@@ -750,31 +3982,203 @@ static int ltc5599_spi_probe(struct spi_device *spi)
 
 	st->chip_info = &ltc5599_chip_info[id->driver_data];
 	st->spi = spi;
+	st->indio_dev = indio_dev;
+	seqcount_mutex_init(&st->seq, &indio_dev->mlock);
+	ltc5599_fill_freq_avail(st);
+	kthread_init_delayed_work(&st->scrub_work, ltc5599_scrub_work);
 
 	indio_dev->dev.parent = &spi->dev;
 	indio_dev->name = id->name;
 	indio_dev->info = &ltc5599_info;
 	indio_dev->modes = INDIO_DIRECT_MODE;
 	indio_dev->channels = st->chip_info->channels;
-	indio_dev->num_channels = 2;
+	indio_dev->num_channels = st->chip_info->num_channels;
+
+	ret = ltc5599_setup_worker(st);
+	if (ret)
+		return ret;
+
+	ret = ltc5599_setup_log(st);
+	if (ret)
+		return ret;
+
+	st->enable_gpio = devm_gpiod_get_optional(&spi->dev, "enable",
+						  GPIOD_OUT_HIGH);
+	if (IS_ERR(st->enable_gpio))
+		return PTR_ERR(st->enable_gpio);
+	if (st->enable_gpio)
+		fsleep(LTC5599_ENABLE_DELAY_US);
 
 	ltc5599_fill_shadowregs(indio_dev);
-	ltc5599_init_registers(indio_dev);
+	ret = ltc5599_init_registers(indio_dev);
+	if (ret)
+		return ret;
+
+	ret = ltc5599_spi_autotune(indio_dev);
+	if (ret)
+		return ret;
+
+	ret = ltc5599_setup_pm(st);
+	if (ret)
+		return ret;
+
+	ret = ltc5599_setup_lo_clk(indio_dev);
+	if (ret)
+		return ret;
+
+	ret = ltc5599_gang_join(st);
+	if (ret)
+		return ret;
+
+	ret = ltc5599_setup_cal(indio_dev);
+	if (ret)
+		return ret;
+
+	ret = ltc5599_setup_temp(indio_dev);
+	if (ret)
+		return ret;
+
+	ret = devm_iio_triggered_buffer_setup_ext(&spi->dev, indio_dev, NULL,
+						  ltc5599_trigger_handler,
+						  IIO_BUFFER_DIRECTION_OUT,
+						  &ltc5599_buffer_setup_ops, NULL);
+	if (ret)
+		return ret;
 
 	ret = iio_device_register(indio_dev);
 	if (ret)
 		return ret;
 
+	ltc5599_log_debugfs_init(indio_dev);
+
+	ret = ltc5599_setup_cdev(st);
+	if (ret) {
+		st->miscdev.fops = NULL;
+		iio_device_unregister(indio_dev);
+		return ret;
+	}
+
+	ltc5599_temp_schedule(st);
+
 	return 0;
 }
 
 static void ltc5599_spi_remove(struct spi_device *spi)
 {
 	struct iio_dev *indio_dev = spi_get_drvdata(spi);
+	struct ltc5599 *st = iio_priv(indio_dev);
+
+	if (st->miscdev.fops)
+		misc_deregister(&st->miscdev);
+
+	/* gang-mates must stop fanning their writes out to this chip */
+	ltc5599_gang_leave(st);
+
+	mutex_lock(&indio_dev->mlock);
+	st->removed = true;
+	mutex_unlock(&indio_dev->mlock);
+
+	if (st->ring) {
+		wake_up(&st->ring_cq_wq);
+		hrtimer_cancel(&st->ring_timer);
+		kthread_cancel_work_sync(&st->ring_work);
+	}
 
 	iio_device_unregister(indio_dev);
+	kthread_cancel_delayed_work_sync(&st->scrub_work);
+	kthread_cancel_delayed_work_sync(&st->temp_work);
+}
+
+static int ltc5599_suspend(struct device *dev)
+{
+	struct iio_dev *indio_dev = dev_get_drvdata(dev);
+	struct ltc5599 *st = iio_priv(indio_dev);
+
+	kthread_cancel_delayed_work_sync(&st->scrub_work);
+	kthread_cancel_delayed_work_sync(&st->temp_work);
+
+	return 0;
+}
+
+static int ltc5599_resume(struct device *dev)
+{
+	struct iio_dev *indio_dev = dev_get_drvdata(dev);
+	struct ltc5599 *st = iio_priv(indio_dev);
+	int ret;
+
+	/*
+	 * A runtime suspended chip is restored on its next use. The check is
+	 * only a shortcut: ltc5599_reset_and_restore() holds a PM reference.
+	 */
+	if (!ltc5599_pm_suspended(st))
+		ret = ltc5599_reset_and_restore(indio_dev);
+	else
+		ret = 0;
+	ltc5599_scrub_schedule(st);
+
+	/* the temperature may have moved arbitrarily while suspended */
+	mutex_lock(&indio_dev->mlock);
+	st->temp_valid = false;
+	st->temp_backoff = 0;
+	mutex_unlock(&indio_dev->mlock);
+	ltc5599_temp_schedule(st);
+
+	return ret;
+}
+
+static int ltc5599_runtime_suspend(struct device *dev)
+{
+	struct ltc5599 *st = iio_priv(dev_get_drvdata(dev));
+
+	gpiod_set_value_cansleep(st->enable_gpio, 0);
+
+	return 0;
+}
+
+/*
+ * Power the chip up and bring back the whole cached image, reset and
+ * restore in one message. This runs from ltc5599_pm_get(), mostly with
+ * mlock already held by the caller, so it cannot take mlock itself. It is
+ * serialised by the PM core instead: every user of the transfer buffers
+ * and of the shadow image's bus side takes a PM reference first, which
+ * waits for a resume in progress, and no resume starts while one is held.
+ */
+static int ltc5599_runtime_resume(struct device *dev)
+{
+	struct iio_dev *indio_dev = dev_get_drvdata(dev);
+	struct ltc5599 *st = iio_priv(indio_dev);
+	ktime_t start = ktime_get();
+	u64 ns;
+	int ret;
+
+	gpiod_set_value_cansleep(st->enable_gpio, 1);
+	fsleep(LTC5599_ENABLE_DELAY_US);
+
+	ret = __ltc5599_restore(indio_dev, true);
+	if (ret) {
+		gpiod_set_value_cansleep(st->enable_gpio, 0);
+		return ret;
+	}
+
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	WRITE_ONCE(st->resume_ns, ns);
+	if (ns > st->resume_max_ns)
+		WRITE_ONCE(st->resume_max_ns, ns);
+
+	/* the temperature may have moved while powered down */
+	if (st->temp_chan && !READ_ONCE(st->removed)) {
+		WRITE_ONCE(st->temp_stale, true);
+		kthread_mod_delayed_work(st->worker, &st->temp_work, 0);
+	}
+
+	return 0;
 }
 
+static const struct dev_pm_ops ltc5599_pm_ops = {
+	SYSTEM_SLEEP_PM_OPS(ltc5599_suspend, ltc5599_resume)
+	RUNTIME_PM_OPS(ltc5599_runtime_suspend, ltc5599_runtime_resume, NULL)
+};
+
 static const struct spi_device_id ltc5599_spi_ids[] = {
 	{ "ltc5599", ID_LTC5599 },
 	{}
@@ -784,6 +4188,7 @@ MODULE_DEVICE_TABLE(spi, ltc5599_spi_ids);
 static struct spi_driver ltc5599_spi_driver = {
 	.driver = {
 		.name = "ltc5599",
+		.pm = pm_ptr(&ltc5599_pm_ops),
 	},
 	.probe = ltc5599_spi_probe,
 	.remove = ltc5599_spi_remove,
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * LTC5599 quadrature modulator in-kernel interface.
+ *
+ * The LTC5599 is an IIO provider: give it an #io-channel-cells = <1>
+ * property and other drivers can look up its output channels (0 = I,
+ * 1 = Q) with iio_channel_get() and change single parameters with
+ * iio_write_channel_attribute(). ltc5599_apply() changes several at once.
+ *
+ * Devices with the same adi,gang-id property form a gang: frequency and
+ * hardware gain written to one member apply to all of them, and
+ * ltc5599_gang_apply() fans arbitrary updates out to every member.
+ *
+ * Copyright 2025 Henning Paul
+ *  Author: Henning Paul <hnch@gmx.net>
+ */
+
+#ifndef __LTC5599_H__
+#define __LTC5599_H__
+
+#include "uapi/ltc5599.h"
+
+struct iio_channel;
+
+/**
+ * struct ltc5599_update - one parameter update
+ * @param:	the parameter to change
+ * @index:	channel or register address, where applicable
+ * @value:	the new value
+ */
+struct ltc5599_update {
+	enum ltc5599_param param;
+	unsigned int index;
+	int value;
+};
+
+int ltc5599_apply(struct iio_channel *chan,
+	const struct ltc5599_update *updates, unsigned int count);
+int ltc5599_gang_apply(struct iio_channel *chan,
+	const struct ltc5599_update *updates, unsigned int count);
+
+#endif /* __LTC5599_H__ */
@@ -0,0 +1,216 @@
+/* SPDX-License-Identifier: GPL-2.0-only WITH Linux-syscall-note */
+/*
+ * LTC5599 quadrature modulator userspace interface.
+ *
+ * With the chardev module parameter set, every LTC5599 gets a character
+ * device /dev/ltc5599-<spi device>, e.g. /dev/ltc5599-spi1.0. Its ioctls
+ * change several parameters with one syscall and one SPI burst and return
+ * the complete cached configuration without touching the bus.
+ *
+ * The same device can be mmap()ed to get a command ring: userspace fills
+ * struct ltc5599_cmd entries and advances sq_head, the driver consumes
+ * them from a kernel thread, coalesces consecutive commands into one SPI
+ * burst and posts a struct ltc5599_completion for each. After publishing
+ * sq_head the producer only needs LTC5599_IOC_DOORBELL when it finds
+ * consumer_idle set. The ring has a single producer.
+ *
+ * Every committed change is also logged with a timestamp. The log is read
+ * in bulk as an array of struct ltc5599_change from change_log in the
+ * device's IIO debugfs directory; change_log_overflow next to it counts
+ * entries that were overwritten before a reader got to them.
+ *
+ * Copyright 2025 Henning Paul
+ *  Author: Henning Paul <hnch@gmx.net>
+ */
+
+#ifndef _UAPI_LTC5599_H
+#define _UAPI_LTC5599_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/**
+ * enum ltc5599_param - configurable parameters
+ * @LTC5599_PARAM_OFFSET:	DC offset of channel index (0 = I, 1 = Q),
+ *				-127..127
+ * @LTC5599_PARAM_FREQUENCY:	LO frequency in Hz, 30 MHz..1.3 GHz
+ * @LTC5599_PARAM_HARDWAREGAIN:	gain in dB, 0..-19
+ * @LTC5599_PARAM_QUADRATURE_CORRECTION: IQ gain ratio code, -127..127
+ * @LTC5599_PARAM_PHASE:	IQ phase balance code, -240..239
+ * @LTC5599_PARAM_REG:		raw value for the register at address index
+ * @LTC5599_PARAM_QDISABLE:	1 turns the Q channel off, 0..1
+ * @LTC5599_PARAM_AGCTRL:	AGC control bit, 0..1
+ */
+enum ltc5599_param {
+	LTC5599_PARAM_OFFSET,
+	LTC5599_PARAM_FREQUENCY,
+	LTC5599_PARAM_HARDWAREGAIN,
+	LTC5599_PARAM_QUADRATURE_CORRECTION,
+	LTC5599_PARAM_PHASE,
+	LTC5599_PARAM_REG,
+	LTC5599_PARAM_QDISABLE,
+	LTC5599_PARAM_AGCTRL,
+};
+
+/**
+ * struct ltc5599_op - one parameter update
+ * @param:	enum ltc5599_param
+ * @index:	channel or register address, where applicable
+ * @value:	the new value
+ */
+struct ltc5599_op {
+	__u16 param;
+	__u16 index;
+	__s32 value;
+};
+
+#define LTC5599_MAX_OPS		64
+
+/**
+ * struct ltc5599_batch - argument of LTC5599_IOC_APPLY
+ * @count:	number of entries at @ops, 1..LTC5599_MAX_OPS
+ * @flags:	must be zero
+ * @ops:	user pointer to an array of struct ltc5599_op
+ *
+ * The operations are applied in order and committed in one SPI burst.
+ * Nothing is written if any of them is invalid.
+ */
+struct ltc5599_batch {
+	__u32 count;
+	__u32 flags;
+	__u64 ops;
+};
+
+/**
+ * struct ltc5599_state - argument of LTC5599_IOC_GET_STATE
+ * @regs:	cached register image, registers 0x00..0x08
+ * @generation:	configuration generation, see config_generation in sysfs
+ * @frequency:	centre of the selected LO band in Hz
+ * @hardwaregain: gain in dB
+ * @offset:	I and Q DC offset
+ * @quadrature_correction: IQ gain ratio code
+ * @phase:	IQ phase balance code
+ */
+struct ltc5599_state {
+	__u8 regs[16];
+	__u32 generation;
+	__u32 frequency;
+	__s32 hardwaregain;
+	__s32 offset[2];
+	__s32 quadrature_correction;
+	__s32 phase;
+	__u32 reserved;
+};
+
+#define LTC5599_CMD_DEADLINE	(1 << 0)
+#define LTC5599_CMD_MAX_OPS	6
+/* deadlines further ahead than this complete with -EINVAL */
+#define LTC5599_CMD_MAX_DELAY_NS	5000000000ULL
+
+/**
+ * struct ltc5599_cmd - command ring entry
+ * @seq:	opaque, copied to the completion
+ * @flags:	LTC5599_CMD_*
+ * @count:	number of valid entries in @ops, 0..LTC5599_CMD_MAX_OPS
+ * @deadline_ns: with LTC5599_CMD_DEADLINE, CLOCK_MONOTONIC time before
+ *		which the command must not be committed
+ * @ops:	parameter updates, applied in order
+ */
+struct ltc5599_cmd {
+	__u32 seq;
+	__u16 flags;
+	__u16 count;
+	__u64 deadline_ns;
+	struct ltc5599_op ops[LTC5599_CMD_MAX_OPS];
+};
+
+/**
+ * struct ltc5599_completion - completion ring entry
+ * @seq:	seq of the command
+ * @status:	0 or a negative error code
+ * @timestamp_ns: CLOCK_MONOTONIC time the command reached the chip
+ */
+struct ltc5599_completion {
+	__u32 seq;
+	__s32 status;
+	__u64 timestamp_ns;
+};
+
+/**
+ * struct ltc5599_ring_ctrl - ring indices at the start of the mapping
+ * @sq_head:	next command slot to be filled, written by userspace
+ * @cq_tail:	next completion to be read, written by userspace
+ * @sq_tail:	next command to be consumed, written by the driver
+ * @cq_head:	next completion slot to be filled, written by the driver
+ * @consumer_idle: set by the driver before it goes to sleep
+ * @cq_overflow: completions dropped because the completion ring was full
+ *
+ * All indices run freely and are reduced modulo LTC5599_RING_ENTRIES.
+ */
+struct ltc5599_ring_ctrl {
+	__u32 sq_head;
+	__u32 cq_tail;
+	__u32 pad0[14];
+	__u32 sq_tail;
+	__u32 cq_head;
+	__u32 consumer_idle;
+	__u32 cq_overflow;
+	__u32 pad1[12];
+};
+
+/**
+ * enum ltc5599_source - origin of a logged change
+ * @LTC5599_SRC_SYSFS:	IIO attributes or debugfs register access
+ * @LTC5599_SRC_KERNEL:	in-kernel consumer, ltc5599_apply() and friends
+ * @LTC5599_SRC_IOCTL:	LTC5599_IOC_APPLY
+ * @LTC5599_SRC_RING:	command ring
+ * @LTC5599_SRC_TRIGGER: output buffer sample
+ * @LTC5599_SRC_LO_CLK:	LO clock rate change
+ * @LTC5599_SRC_CAL:	calibration run or calibration store change
+ * @LTC5599_SRC_TEMP:	temperature correction
+ * @LTC5599_SRC_SCRUB:	scrubber restoring a corrupted register file
+ */
+enum ltc5599_source {
+	LTC5599_SRC_SYSFS,
+	LTC5599_SRC_KERNEL,
+	LTC5599_SRC_IOCTL,
+	LTC5599_SRC_RING,
+	LTC5599_SRC_TRIGGER,
+	LTC5599_SRC_LO_CLK,
+	LTC5599_SRC_CAL,
+	LTC5599_SRC_TEMP,
+	LTC5599_SRC_SCRUB,
+};
+
+/**
+ * struct ltc5599_change - change log entry
+ * @timestamp_ns: CLOCK_MONOTONIC time the change reached the chip
+ * @seq:	sequence number, a gap means entries were lost
+ * @changed:	bitmask of the registers that changed
+ * @source:	enum ltc5599_source
+ * @reserved:	zero
+ * @regs:	register image as written, registers 0x00..0x08
+ */
+struct ltc5599_change {
+	__u64 timestamp_ns;
+	__u32 seq;
+	__u16 changed;
+	__u8 source;
+	__u8 reserved;
+	__u8 regs[16];
+};
+
+#define LTC5599_RING_ENTRIES	256
+#define LTC5599_RING_SQ_OFFSET	sizeof(struct ltc5599_ring_ctrl)
+#define LTC5599_RING_CQ_OFFSET	(LTC5599_RING_SQ_OFFSET + \
+		LTC5599_RING_ENTRIES * sizeof(struct ltc5599_cmd))
+#define LTC5599_RING_SIZE	(LTC5599_RING_CQ_OFFSET + \
+		LTC5599_RING_ENTRIES * sizeof(struct ltc5599_completion))
+
+#define LTC5599_IOC_MAGIC	0xB5
+
+#define LTC5599_IOC_APPLY	_IOW(LTC5599_IOC_MAGIC, 0, struct ltc5599_batch)
+#define LTC5599_IOC_GET_STATE	_IOR(LTC5599_IOC_MAGIC, 1, struct ltc5599_state)
+#define LTC5599_IOC_DOORBELL	_IO(LTC5599_IOC_MAGIC, 2)
+
+#endif /* _UAPI_LTC5599_H */
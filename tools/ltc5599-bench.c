@@ -0,0 +1,478 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * LTC5599 attribute latency and throughput benchmark.
+ *
+ * Drives the writable IIO attributes of the ltc5599 driver from pinned
+ * threads and reports p50/p99/p99.9 latency and sustained updates per
+ * second, single-threaded per attribute and as a mixed multi-threaded
+ * read/write load that exposes contention on the device lock.
+ *
+ * Copyright 2025 Henning Paul
+ *  Author: Henning Paul <hnch@gmx.net>
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#define IIO_DEVICES		"/sys/bus/iio/devices"
+#define MAX_SAMPLES		(1 << 20)
+
+struct bench_attr {
+	const char	*name;
+	char		val[2][32];
+};
+
+/* writable attributes, each toggled between two values that differ in hardware */
+static struct bench_attr attrs[] = {
+	{ "out_altvoltage0_offset",			{ "-10", "10" } },
+	{ "out_altvoltage1_offset",			{ "-10", "10" } },
+	{ "out_altvoltage_frequency",			{ "1000000000", "500000000" } },
+	{ "out_altvoltage_hardwaregain",		{ "-3", "-6" } },
+	{ "out_altvoltage_phase",			{ "-20", "20" } },
+	{ "out_altvoltage_quadrature_correction_raw",	{ "-10", "10" } },
+};
+
+#define NUM_ATTRS (sizeof(attrs) / sizeof(attrs[0]))
+
+struct stats {
+	uint64_t	*ns;
+	size_t		n;
+	unsigned long	ops;
+	uint64_t	elapsed_ns;
+	unsigned long	errors;
+};
+
+struct worker {
+	pthread_t	thread;
+	int		cpu;
+	bool		writer;
+	int		fd[NUM_ATTRS];
+	struct stats	st;
+};
+
+static const char *devdir;
+static unsigned int iterations = 10000;
+static unsigned int writers = 2, readers = 2;
+static unsigned int duration = 5;
+static int first_cpu;
+static bool json;
+static const char *only_attr;
+static volatile int stop;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int pin(int cpu)
+{
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu % (ncpu > 0 ? ncpu : 1), &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static int open_attr(const char *name, int flags)
+{
+	char path[512];
+
+	snprintf(path, sizeof(path), "%s/%s", devdir, name);
+	return open(path, flags);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile(const struct stats *st, double p)
+{
+	size_t i;
+
+	if (!st->n)
+		return 0;
+	i = (size_t)(p * st->n + 0.999999);
+	if (i)
+		i--;
+	if (i >= st->n)
+		i = st->n - 1;
+	return st->ns[i];
+}
+
+static void stats_record(struct stats *st, uint64_t ns)
+{
+	st->ops++;
+	if (st->n < MAX_SAMPLES)
+		st->ns[st->n++] = ns;
+}
+
+static int stats_init(struct stats *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->ns = malloc(MAX_SAMPLES * sizeof(*st->ns));
+	return st->ns ? 0 : -ENOMEM;
+}
+
+static void stats_merge(struct stats *dst, const struct stats *src)
+{
+	size_t n = src->n;
+
+	if (dst->n + n > MAX_SAMPLES)
+		n = MAX_SAMPLES - dst->n;
+	memcpy(dst->ns + dst->n, src->ns, n * sizeof(*src->ns));
+	dst->n += n;
+	dst->ops += src->ops;
+	dst->errors += src->errors;
+}
+
+static void report(const char *test, const char *attr, const char *op,
+		   struct stats *st, bool last)
+{
+	double rate = st->elapsed_ns ? st->ops * 1e9 / st->elapsed_ns : 0;
+
+	qsort(st->ns, st->n, sizeof(*st->ns), cmp_u64);
+
+	if (json) {
+		printf("    { \"test\": \"%s\", \"attr\": \"%s\", \"op\": \"%s\", "
+		       "\"samples\": %zu, \"errors\": %lu, \"p50_ns\": %llu, "
+		       "\"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu, "
+		       "\"ops_per_s\": %.1f }%s\n",
+		       test, attr, op, st->n, st->errors,
+		       (unsigned long long)percentile(st, 0.50),
+		       (unsigned long long)percentile(st, 0.99),
+		       (unsigned long long)percentile(st, 0.999),
+		       (unsigned long long)(st->n ? st->ns[st->n - 1] : 0),
+		       rate, last ? "" : ",");
+		return;
+	}
+
+	printf("%-8s %-42s %-5s %8zu %6lu %9.1f %9.1f %9.1f %10.0f\n",
+	       test, attr, op, st->n, st->errors,
+	       percentile(st, 0.50) / 1e3, percentile(st, 0.99) / 1e3,
+	       percentile(st, 0.999) / 1e3, rate);
+}
+
+/* single pinned thread, one attribute, alternate between two values */
+static int bench_single(const struct bench_attr *a, bool write, struct stats *st)
+{
+	char buf[64];
+	uint64_t t0, t1, start;
+	unsigned int i;
+	ssize_t ret;
+	int fd;
+
+	fd = open_attr(a->name, write ? O_WRONLY : O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		const char *v = a->val[i & 1];
+
+		t0 = now_ns();
+		if (write)
+			ret = pwrite(fd, v, strlen(v), 0);
+		else
+			ret = pread(fd, buf, sizeof(buf), 0);
+		t1 = now_ns();
+		if (ret < 0)
+			st->errors++;
+		else
+			stats_record(st, t1 - t0);
+	}
+	st->elapsed_ns = now_ns() - start;
+
+	close(fd);
+	return 0;
+}
+
+static void *mixed_thread(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int i = 0, k;
+	char buf[64];
+	uint64_t t0, t1;
+	ssize_t ret;
+
+	pin(w->cpu);
+
+	while (!stop) {
+		k = i % NUM_ATTRS;
+		if (w->fd[k] < 0) {
+			i++;
+			continue;
+		}
+
+		t0 = now_ns();
+		if (w->writer) {
+			const char *v = attrs[k].val[(i / NUM_ATTRS) & 1];
+
+			ret = pwrite(w->fd[k], v, strlen(v), 0);
+		} else {
+			ret = pread(w->fd[k], buf, sizeof(buf), 0);
+		}
+		t1 = now_ns();
+		if (ret < 0)
+			w->st.errors++;
+		else
+			stats_record(&w->st, t1 - t0);
+		i++;
+	}
+
+	return NULL;
+}
+
+/* writers and readers hammering all attributes concurrently */
+static int bench_mixed(struct stats *wr, struct stats *rd)
+{
+	unsigned int n = writers + readers, i, k;
+	struct worker *w;
+	uint64_t start, elapsed;
+	int ret = 0;
+
+	w = calloc(n, sizeof(*w));
+	if (!w)
+		return -ENOMEM;
+
+	for (i = 0; i < n; i++) {
+		w[i].cpu = first_cpu + 1 + i;
+		w[i].writer = i < writers;
+		if (stats_init(&w[i].st))
+			return -ENOMEM;
+		for (k = 0; k < NUM_ATTRS; k++) {
+			if (only_attr && strcmp(only_attr, attrs[k].name))
+				w[i].fd[k] = -1;
+			else
+				w[i].fd[k] = open_attr(attrs[k].name,
+						       w[i].writer ? O_WRONLY : O_RDONLY);
+		}
+	}
+
+	stop = 0;
+	start = now_ns();
+	for (i = 0; i < n; i++) {
+		ret = pthread_create(&w[i].thread, NULL, mixed_thread, &w[i]);
+		if (ret) {
+			n = i;
+			stop = 1;
+			break;
+		}
+	}
+
+	if (!stop)
+		sleep(duration);
+	stop = 1;
+	for (i = 0; i < n; i++)
+		pthread_join(w[i].thread, NULL);
+	elapsed = now_ns() - start;
+
+	for (i = 0; i < n; i++) {
+		stats_merge(w[i].writer ? wr : rd, &w[i].st);
+		for (k = 0; k < NUM_ATTRS; k++)
+			if (w[i].fd[k] >= 0)
+				close(w[i].fd[k]);
+		free(w[i].st.ns);
+	}
+	wr->elapsed_ns = rd->elapsed_ns = elapsed;
+	free(w);
+
+	return -ret;
+}
+
+static int find_device(void)
+{
+	static char path[512];
+	char name[64];
+	struct dirent *de;
+	DIR *dir;
+	FILE *f;
+
+	dir = opendir(IIO_DEVICES);
+	if (!dir)
+		return -errno;
+
+	while ((de = readdir(dir))) {
+		if (strncmp(de->d_name, "iio:device", 10))
+			continue;
+		snprintf(path, sizeof(path), IIO_DEVICES "/%s/name", de->d_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		if (fgets(name, sizeof(name), f) && !strncmp(name, "ltc5599", 7)) {
+			fclose(f);
+			snprintf(path, sizeof(path), IIO_DEVICES "/%s", de->d_name);
+			devdir = path;
+			closedir(dir);
+			return 0;
+		}
+		fclose(f);
+	}
+
+	closedir(dir);
+	return -ENODEV;
+}
+
+/* toggle between two bands the device actually offers */
+static void pick_frequencies(void)
+{
+	char buf[4096], *tok, *save;
+	long lo = 0, hi = 0, v;
+	ssize_t len;
+	int fd;
+
+	fd = open_attr("out_altvoltage_frequency_available", O_RDONLY);
+	if (fd < 0)
+		return;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return;
+	buf[len] = 0;
+
+	for (tok = strtok_r(buf, " \n", &save); tok; tok = strtok_r(NULL, " \n", &save)) {
+		v = strtol(tok, NULL, 10);
+		if (!lo || v < lo)
+			lo = v;
+		if (v > hi)
+			hi = v;
+	}
+
+	if (lo && hi > lo) {
+		snprintf(attrs[2].val[0], sizeof(attrs[2].val[0]), "%ld", hi);
+		snprintf(attrs[2].val[1], sizeof(attrs[2].val[1]), "%ld", lo);
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -d DIR    IIO device directory (default: first ltc5599)\n"
+		"  -n N      iterations per attribute in the single-thread tests (%u)\n"
+		"  -w N      writer threads in the mixed test (%u)\n"
+		"  -r N      reader threads in the mixed test (%u)\n"
+		"  -t SEC    duration of the mixed test (%u)\n"
+		"  -c CPU    CPU for the single-thread tests, mixed threads follow (%d)\n"
+		"  -a ATTR   only benchmark this attribute\n"
+		"  -j        machine-readable JSON output\n",
+		prog, iterations, writers, readers, duration, first_cpu);
+}
+
+int main(int argc, char **argv)
+{
+	struct stats st, wr, rd;
+	struct utsname uts;
+	unsigned int i;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "d:n:w:r:t:c:a:jh")) != -1) {
+		switch (opt) {
+		case 'd':
+			devdir = optarg;
+			break;
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			writers = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			readers = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			first_cpu = strtol(optarg, NULL, 0);
+			break;
+		case 'a':
+			only_attr = optarg;
+			break;
+		case 'j':
+			json = true;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (!devdir && find_device()) {
+		fprintf(stderr, "no ltc5599 device found, use -d\n");
+		return 1;
+	}
+	if (iterations > MAX_SAMPLES)
+		iterations = MAX_SAMPLES;
+
+	pick_frequencies();
+	pin(first_cpu);
+	uname(&uts);
+
+	if (json)
+		printf("{\n  \"device\": \"%s\",\n  \"kernel\": \"%s\",\n"
+		       "  \"iterations\": %u,\n  \"writers\": %u,\n  \"readers\": %u,\n"
+		       "  \"duration_s\": %u,\n  \"results\": [\n",
+		       devdir, uts.release, iterations, writers, readers, duration);
+	else
+		printf("%-8s %-42s %-5s %8s %6s %9s %9s %9s %10s\n", "test", "attribute",
+		       "op", "samples", "errors", "p50 us", "p99 us", "p99.9 us", "ops/s");
+
+	if (stats_init(&st) || stats_init(&wr) || stats_init(&rd)) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	for (i = 0; i < NUM_ATTRS; i++) {
+		if (only_attr && strcmp(only_attr, attrs[i].name))
+			continue;
+
+		st.n = st.ops = st.errors = 0;
+		ret = bench_single(&attrs[i], true, &st);
+		if (ret)
+			fprintf(stderr, "%s: %s\n", attrs[i].name, strerror(-ret));
+		else
+			report("single", attrs[i].name, "write", &st, false);
+
+		st.n = st.ops = st.errors = 0;
+		ret = bench_single(&attrs[i], false, &st);
+		if (ret)
+			fprintf(stderr, "%s: %s\n", attrs[i].name, strerror(-ret));
+		else
+			report("single", attrs[i].name, "read", &st, false);
+	}
+
+	ret = bench_mixed(&wr, &rd);
+	if (ret)
+		fprintf(stderr, "mixed: %s\n", strerror(-ret));
+	report("mixed", only_attr ? only_attr : "all", "write", &wr, false);
+	report("mixed", only_attr ? only_attr : "all", "read", &rd, true);
+
+	if (json)
+		printf("  ]\n}\n");
+
+	free(st.ns);
+	free(wr.ns);
+	free(rd.ns);
+
+	return ret ? 1 : 0;
+}
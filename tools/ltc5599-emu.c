@@ -0,0 +1,445 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * FUSE emulation of the LTC5599 IIO sysfs tree.
+ *
+ * Mounts one directory per emulated device, iio:device0..N-1, holding the
+ * parameter attributes the driver creates. Writes go through the register
+ * model and so get the same range checks, clamping and quantisation as
+ * write_raw (band mapping, gain clamped at -19 dB, phase range); reads
+ * decode the register image like read_raw. Every operation can be delayed
+ * to mimic the bus, writes under a per-device lock like the driver's mlock.
+ *
+ * phase_mdeg and quadrature_correction_mdb are read-only here. Attributes
+ * that need the hardware or its surroundings are not emulated: recovery,
+ * the scrubber, calibration, LO-match overrides, the temperature and
+ * output level control, SPI tuning, write verification and runtime PM.
+ *
+ *	ltc5599-emu --instances=32 --latency=40 /tmp/iio
+ *	ltc5599-bench -d /tmp/iio/iio:device7
+ *
+ * Copyright 2025 Henning Paul
+ *  Author: Henning Paul <hnch@gmx.net>
+ */
+
+#define FUSE_USE_VERSION 31
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fuse.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ltc5599-model.h"
+
+#define DEV_PREFIX	"iio:device"
+#define ATTR_SIZE	4096
+
+enum attr_kind {
+	ATTR_NAME,
+	ATTR_PARAM,
+	ATTR_AVAIL,
+	ATTR_GENERATION,
+	ATTR_PHYS,
+};
+
+struct emu_attr {
+	const char		*name;
+	enum attr_kind		kind;
+	enum ltc5599_param	param;
+	unsigned int		index;
+	const char		*avail;
+};
+
+static char freq_avail[LTC5599_NUM_BANDS * 12 + 2];
+static char band_edges[LTC5599_NUM_BANDS * 12 + 2];
+
+static const struct emu_attr attrs[] = {
+	{ "name", ATTR_NAME },
+	{ "config_generation", ATTR_GENERATION },
+	{ "out_altvoltage0_offset", ATTR_PARAM, LTC5599_PARAM_OFFSET, 0 },
+	{ "out_altvoltage1_offset", ATTR_PARAM, LTC5599_PARAM_OFFSET, 1 },
+	{ "out_altvoltage0_offset_available", ATTR_AVAIL, 0, 0, "[-127 1 127]\n" },
+	{ "out_altvoltage1_offset_available", ATTR_AVAIL, 0, 0, "[-127 1 127]\n" },
+	{ "out_altvoltage_frequency", ATTR_PARAM, LTC5599_PARAM_FREQUENCY },
+	{ "out_altvoltage_frequency_available", ATTR_AVAIL, 0, 0, freq_avail },
+	{ "out_altvoltage_frequency_band_edges", ATTR_AVAIL, 0, 0, band_edges },
+	{ "out_altvoltage_hardwaregain", ATTR_PARAM, LTC5599_PARAM_HARDWAREGAIN },
+	{ "out_altvoltage_hardwaregain_available", ATTR_AVAIL, 0, 0,
+	  "[-19.000000 dB 1.000000 dB 0.000000 dB]\n" },
+	{ "out_altvoltage_quadrature_correction_raw", ATTR_PARAM,
+	  LTC5599_PARAM_QUADRATURE_CORRECTION },
+	{ "out_altvoltage_quadrature_correction_raw_available", ATTR_AVAIL, 0, 0,
+	  "[-127 1 127]\n" },
+	{ "out_altvoltage_phase", ATTR_PARAM, LTC5599_PARAM_PHASE },
+	{ "out_altvoltage_phase_available", ATTR_AVAIL, 0, 0, "[-240 1 239]\n" },
+	{ "out_altvoltage_phase_mdeg", ATTR_PHYS, LTC5599_PARAM_PHASE },
+	{ "out_altvoltage_quadrature_correction_mdb", ATTR_PHYS,
+	  LTC5599_PARAM_QUADRATURE_CORRECTION },
+	{ "q_disable", ATTR_PARAM, LTC5599_PARAM_QDISABLE },
+	{ "agc_control", ATTR_PARAM, LTC5599_PARAM_AGCTRL },
+};
+
+#define NUM_ATTRS (sizeof(attrs) / sizeof(attrs[0]))
+
+struct emu_dev {
+	pthread_mutex_t	lock;
+	uint8_t		regs[LTC5599_NUM_REGS];
+	unsigned int	generation;
+};
+
+static struct options {
+	unsigned int	instances;
+	unsigned int	latency_us;
+	int		help;
+} options = {
+	.instances = 1,
+};
+
+#define OPTION(t, p) { t, offsetof(struct options, p), 1 }
+static const struct fuse_opt option_spec[] = {
+	OPTION("--instances=%u", instances),
+	OPTION("--latency=%u", latency_us),
+	OPTION("-h", help),
+	OPTION("--help", help),
+	FUSE_OPT_END
+};
+
+static struct emu_dev *devs;
+
+/* split "/iio:deviceN/attr" into the device and the attribute */
+static int lookup(const char *path, struct emu_dev **dev, const struct emu_attr **attr)
+{
+	unsigned int n, i;
+	int len;
+
+	*dev = NULL;
+	*attr = NULL;
+
+	if (!strcmp(path, "/"))
+		return 0;
+
+	if (sscanf(path, "/" DEV_PREFIX "%u%n", &n, &len) != 1 || n >= options.instances)
+		return -ENOENT;
+	*dev = &devs[n];
+
+	path += len;
+	if (!*path)
+		return 0;
+	if (*path++ != '/')
+		return -ENOENT;
+
+	for (i = 0; i < NUM_ATTRS; i++) {
+		if (!strcmp(path, attrs[i].name)) {
+			*attr = &attrs[i];
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+static int emu_getattr(const char *path, struct stat *st, struct fuse_file_info *fi)
+{
+	const struct emu_attr *attr;
+	struct emu_dev *dev;
+	int ret;
+
+	ret = lookup(path, &dev, &attr);
+	if (ret)
+		return ret;
+
+	memset(st, 0, sizeof(*st));
+	if (!attr) {
+		st->st_mode = S_IFDIR | 0755;
+		st->st_nlink = 2;
+	} else {
+		st->st_mode = S_IFREG | (attr->kind == ATTR_PARAM ? 0644 : 0444);
+		st->st_nlink = 1;
+		st->st_size = ATTR_SIZE;
+	}
+
+	return 0;
+}
+
+static int emu_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+		       off_t off, struct fuse_file_info *fi,
+		       enum fuse_readdir_flags flags)
+{
+	const struct emu_attr *attr;
+	struct emu_dev *dev;
+	char name[32];
+	unsigned int i;
+	int ret;
+
+	ret = lookup(path, &dev, &attr);
+	if (ret)
+		return ret;
+	if (attr)
+		return -ENOTDIR;
+
+	filler(buf, ".", NULL, 0, 0);
+	filler(buf, "..", NULL, 0, 0);
+
+	if (!dev) {
+		for (i = 0; i < options.instances; i++) {
+			snprintf(name, sizeof(name), DEV_PREFIX "%u", i);
+			filler(buf, name, NULL, 0, 0);
+		}
+		return 0;
+	}
+
+	for (i = 0; i < NUM_ATTRS; i++)
+		filler(buf, attrs[i].name, NULL, 0, 0);
+
+	return 0;
+}
+
+static int emu_open(const char *path, struct fuse_file_info *fi)
+{
+	const struct emu_attr *attr;
+	struct emu_dev *dev;
+	int ret;
+
+	ret = lookup(path, &dev, &attr);
+	if (ret)
+		return ret;
+	if (!attr)
+		return -EISDIR;
+	if ((fi->flags & O_ACCMODE) != O_RDONLY && attr->kind != ATTR_PARAM)
+		return -EACCES;
+
+	/* like sysfs, every read sees the current value */
+	fi->direct_io = 1;
+
+	return 0;
+}
+
+/* format the value the way read_raw and the IIO core do */
+static int format_attr(struct emu_dev *dev, const struct emu_attr *attr,
+		       char *buf, size_t size)
+{
+	uint8_t regs[LTC5599_NUM_REGS];
+	unsigned int gen;
+	int val;
+
+	switch (attr->kind) {
+	case ATTR_NAME:
+		return snprintf(buf, size, "ltc5599\n");
+	case ATTR_AVAIL:
+		return snprintf(buf, size, "%s", attr->avail);
+	case ATTR_GENERATION:
+		pthread_mutex_lock(&dev->lock);
+		gen = dev->generation;
+		pthread_mutex_unlock(&dev->lock);
+		return snprintf(buf, size, "%u\n", gen);
+	case ATTR_PARAM:
+	case ATTR_PHYS:
+		break;
+	}
+
+	pthread_mutex_lock(&dev->lock);
+	memcpy(regs, dev->regs, sizeof(regs));
+	pthread_mutex_unlock(&dev->lock);
+
+	if (ltc5599_model_read(regs, attr->param, attr->index, &val))
+		return -EINVAL;
+
+	if (attr->kind == ATTR_PHYS) {
+		/* micro-degrees or micro-dB, shown as milli units */
+		val = attr->param == LTC5599_PARAM_PHASE ?
+		      ltc5599_model_phase_udeg(val) : ltc5599_model_gainrat_udb(val);
+		return snprintf(buf, size, "%s%d.%06d\n", val < 0 ? "-" : "",
+				abs(val) / 1000, abs(val) % 1000 * 1000);
+	}
+
+	if (attr->param == LTC5599_PARAM_HARDWAREGAIN)
+		return snprintf(buf, size, "%d.000000 dB\n", val);
+
+	return snprintf(buf, size, "%d\n", val);
+}
+
+static int emu_read(const char *path, char *buf, size_t size, off_t off,
+		    struct fuse_file_info *fi)
+{
+	const struct emu_attr *attr;
+	struct emu_dev *dev;
+	char tmp[ATTR_SIZE];
+	int ret, len;
+
+	ret = lookup(path, &dev, &attr);
+	if (ret)
+		return ret;
+	if (!attr)
+		return -EISDIR;
+
+	if (options.latency_us)
+		usleep(options.latency_us);
+
+	len = format_attr(dev, attr, tmp, sizeof(tmp));
+	if (len < 0)
+		return len;
+	if (off >= len)
+		return 0;
+	if (size > (size_t)(len - off))
+		size = len - off;
+	memcpy(buf, tmp + off, size);
+
+	return size;
+}
+
+/*
+ * Parse like iio_str_to_fixpoint() and keep the integer part, which is
+ * all write_raw looks at.
+ */
+static int parse_value(const char *buf, size_t size, int *val)
+{
+	char tmp[32], *end;
+	long v;
+
+	if (!size || size >= sizeof(tmp))
+		return -EINVAL;
+	memcpy(tmp, buf, size);
+	tmp[size] = 0;
+
+	errno = 0;
+	v = strtol(tmp, &end, 10);
+	if (end == tmp || errno)
+		return -EINVAL;
+	if (*end == '.') {
+		end++;
+		while (*end >= '0' && *end <= '9')
+			end++;
+	}
+	while (*end == ' ')
+		end++;
+	if (!strncmp(end, "dB", 2))
+		end += 2;
+	if (*end == '\n')
+		end++;
+	if (*end || v < -2147483648L || v > 2147483647L)
+		return -EINVAL;
+
+	*val = v;
+	return 0;
+}
+
+static int emu_write(const char *path, const char *buf, size_t size, off_t off,
+		     struct fuse_file_info *fi)
+{
+	uint8_t regs[LTC5599_NUM_REGS];
+	const struct emu_attr *attr;
+	struct emu_dev *dev;
+	int ret, val;
+
+	ret = lookup(path, &dev, &attr);
+	if (ret)
+		return ret;
+	if (!attr || attr->kind != ATTR_PARAM)
+		return -EACCES;
+
+	ret = parse_value(buf, size, &val);
+	if (ret)
+		return ret;
+
+	pthread_mutex_lock(&dev->lock);
+	memcpy(regs, dev->regs, sizeof(regs));
+	ret = ltc5599_model_apply(regs, attr->param, attr->index, val);
+	if (!ret && memcmp(regs, dev->regs, sizeof(regs))) {
+		/* the bus transfer happens under the device lock */
+		if (options.latency_us)
+			usleep(options.latency_us);
+		memcpy(dev->regs, regs, sizeof(regs));
+		dev->generation++;
+	}
+	pthread_mutex_unlock(&dev->lock);
+
+	return ret ? ret : (int)size;
+}
+
+static int emu_truncate(const char *path, off_t size, struct fuse_file_info *fi)
+{
+	const struct emu_attr *attr;
+	struct emu_dev *dev;
+
+	return lookup(path, &dev, &attr);
+}
+
+static void *emu_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
+{
+	cfg->direct_io = 1;
+	cfg->entry_timeout = 60;
+	cfg->attr_timeout = 60;
+
+	return NULL;
+}
+
+static const struct fuse_operations emu_ops = {
+	.init		= emu_init,
+	.getattr	= emu_getattr,
+	.readdir	= emu_readdir,
+	.open		= emu_open,
+	.read		= emu_read,
+	.write		= emu_write,
+	.truncate	= emu_truncate,
+};
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [options] <mountpoint>\n"
+	       "  --instances=N   number of emulated devices (1)\n"
+	       "  --latency=US    delay of every attribute access in microseconds (0)\n\n",
+	       prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+	unsigned int i, band;
+	int len = 0, ret;
+
+	if (fuse_opt_parse(&args, &options, option_spec, NULL) == -1)
+		return 1;
+
+	if (options.help) {
+		usage(argv[0]);
+		fuse_opt_add_arg(&args, "--help");
+		args.argv[0][0] = '\0';
+	}
+
+	if (!options.instances) {
+		fprintf(stderr, "need at least one instance\n");
+		return 1;
+	}
+
+	devs = calloc(options.instances, sizeof(*devs));
+	if (!devs)
+		return 1;
+	for (i = 0; i < options.instances; i++) {
+		pthread_mutex_init(&devs[i].lock, NULL);
+		ltc5599_model_reset(devs[i].regs);
+	}
+
+	/* ascending frequency, i.e. descending control word */
+	for (band = LTC5599_NUM_BANDS; band > 0; band--)
+		len += snprintf(freq_avail + len, sizeof(freq_avail) - len, "%d%s",
+				ltc5599_model_band_to_freq(band),
+				band > 1 ? " " : "\n");
+
+	len = 0;
+	for (band = LTC5599_NUM_BANDS - 1; band > 0; band--)
+		len += snprintf(band_edges + len, sizeof(band_edges) - len, "%u%s",
+				ltc5599_model_band_edge_khz(band) * 1000,
+				band > 1 ? " " : "\n");
+
+	ret = fuse_main(args.argc, args.argv, &emu_ops, NULL);
+
+	fuse_opt_free_args(&args);
+	free(devs);
+
+	return ret;
+}
@@ -0,0 +1,374 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Model-based IQ imbalance solver for the LTC5599.
+ *
+ * The fit searches the imbalance (e, p) on a grid that is refined around
+ * the best point a few times. For each grid point the scale and noise
+ * floor follow in closed form from a weighted linear least squares fit in
+ * the linear power domain, weighted by 1/P^2 so that the residual
+ * approximates the error in dB. The per-point loops run over flat
+ * arrays so the compiler can vectorise them; grid rows are spread over
+ * threads.
+ *
+ * Copyright 2025 Henning Paul
+ *  Author: Henning Paul <hnch@gmx.net>
+ */
+
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ltc5599-iq.h"
+#include "ltc5599-model.h"
+
+#define GRID_POINTS	129
+#define GRID_LEVELS	4
+/* the refined grid spans this many steps of the previous one */
+#define GRID_ZOOM	4
+/* initial search range, wider than the correction range */
+#define GAIN_RANGE_DB	1.0
+#define PHASE_RANGE_DEG	5.0
+#define MAX_THREADS	64
+
+#define NUM_GAIN_CODES	(LTC5599_CODE_MAX - LTC5599_CODE_MIN + 1)
+#define NUM_PHASE_CODES	(LTC5599_PHASE_MAX - LTC5599_PHASE_MIN + 1)
+
+/* physical correction per code, from the driver's register encodings */
+static double gain_corr_db[NUM_GAIN_CODES];
+static double phase_corr_deg[NUM_PHASE_CODES];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void init_tables(void)
+{
+	int i;
+
+	for (i = 0; i < NUM_GAIN_CODES; i++)
+		gain_corr_db[i] = ltc5599_model_gainrat_udb(i + LTC5599_CODE_MIN) / 1e6;
+	for (i = 0; i < NUM_PHASE_CODES; i++)
+		phase_corr_deg[i] = ltc5599_model_phase_udeg(i + LTC5599_PHASE_MIN) / 1e6;
+}
+
+static inline double image_term(double err_db, double err_deg)
+{
+	double g = pow(10.0, err_db / 20.0);
+
+	return 1.0 + g * g - 2.0 * g * cos(err_deg * M_PI / 180.0);
+}
+
+static inline double db_to_lin(double db)
+{
+	return pow(10.0, db / 10.0);
+}
+
+static inline double lin_to_db(double lin)
+{
+	return lin > 0 ? 10.0 * log10(lin) : -INFINITY;
+}
+
+struct problem {
+	unsigned int	n;
+	bool		fit_floor;
+	double		*gcorr;		/* per measurement, dB */
+	double		*pcorr;		/* per measurement, radians */
+	double		*p;		/* measured power, linear */
+	double		*w;		/* 1 / p^2 */
+};
+
+struct grid {
+	double	e0, de;
+	double	p0, dp;
+};
+
+struct result {
+	double	cost;
+	double	e, p, a, floor;
+};
+
+struct job {
+	const struct problem	*pb;
+	const struct grid	*grid;
+	unsigned int		row_first, row_step;
+	struct result		best;
+	/* code grid prediction */
+	const struct ltc5599_iq_fit *fit;
+	double			best_image;
+	int			gain_code, phase_code;
+};
+
+/* closed form scale and floor at one imbalance, returns the cost */
+static double fit_point(const struct problem *pb, double e, double p,
+			double *t, double *a_out, double *n_out)
+{
+	double sw = 0, st = 0, stt = 0, sp = 0, stp = 0, cost = 0;
+	double a, nf, det, g, r;
+	unsigned int i;
+
+	for (i = 0; i < pb->n; i++) {
+		g = exp((e + pb->gcorr[i]) * (M_LN10 / 20.0));
+		t[i] = 1.0 + g * g - 2.0 * g * cos(p * (M_PI / 180.0) + pb->pcorr[i]);
+	}
+
+	for (i = 0; i < pb->n; i++) {
+		sw += pb->w[i];
+		st += pb->w[i] * t[i];
+		stt += pb->w[i] * t[i] * t[i];
+		sp += pb->w[i] * pb->p[i];
+		stp += pb->w[i] * t[i] * pb->p[i];
+	}
+
+	nf = 0;
+	a = stt > 0 ? stp / stt : 0;
+	if (pb->fit_floor) {
+		det = stt * sw - st * st;
+		if (det > 0) {
+			nf = (stt * sp - st * stp) / det;
+			a = (stp * sw - st * sp) / det;
+		}
+		if (nf < 0) {
+			nf = 0;
+			a = stt > 0 ? stp / stt : 0;
+		}
+	}
+	if (a <= 0)
+		return DBL_MAX;
+
+	for (i = 0; i < pb->n; i++) {
+		r = a * t[i] + nf - pb->p[i];
+		cost += pb->w[i] * r * r;
+	}
+
+	*a_out = a;
+	*n_out = nf;
+	return cost;
+}
+
+static void *grid_worker(void *arg)
+{
+	struct job *job = arg;
+	const struct grid *gr = job->grid;
+	double t[job->pb->n], a, nf, cost, e, p;
+	unsigned int i, j;
+
+	job->best.cost = DBL_MAX;
+	for (i = job->row_first; i < GRID_POINTS; i += job->row_step) {
+		e = gr->e0 + i * gr->de;
+		for (j = 0; j < GRID_POINTS; j++) {
+			p = gr->p0 + j * gr->dp;
+			cost = fit_point(job->pb, e, p, t, &a, &nf);
+			if (cost < job->best.cost) {
+				job->best.cost = cost;
+				job->best.e = e;
+				job->best.p = p;
+				job->best.a = a;
+				job->best.floor = nf;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/* evaluate every code pair against the fitted imbalance */
+static void *code_worker(void *arg)
+{
+	struct job *job = arg;
+	const struct ltc5599_iq_fit *fit = job->fit;
+	double row[NUM_PHASE_CODES], g, c;
+	unsigned int i, j;
+
+	job->best_image = DBL_MAX;
+	for (i = job->row_first; i < NUM_GAIN_CODES; i += job->row_step) {
+		g = pow(10.0, (fit->gain_err_db + gain_corr_db[i]) / 20.0);
+		for (j = 0; j < NUM_PHASE_CODES; j++) {
+			c = cos((fit->phase_err_deg + phase_corr_deg[j]) * (M_PI / 180.0));
+			row[j] = 1.0 + g * g - 2.0 * g * c;
+		}
+		for (j = 0; j < NUM_PHASE_CODES; j++) {
+			if (row[j] < job->best_image) {
+				job->best_image = row[j];
+				job->gain_code = i + LTC5599_CODE_MIN;
+				job->phase_code = j + LTC5599_PHASE_MIN;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static void run_jobs(struct job *jobs, unsigned int threads,
+		     void *(*fn)(void *))
+{
+	pthread_t tid[MAX_THREADS];
+	unsigned int i, started = 0;
+
+	for (i = 0; i < threads; i++) {
+		jobs[i].row_first = i;
+		jobs[i].row_step = threads;
+	}
+
+	/* job 0 runs on the calling thread */
+	for (i = 1; i < threads; i++) {
+		if (pthread_create(&tid[i], NULL, fn, &jobs[i]))
+			break;
+		started = i;
+	}
+
+	/* rows of jobs that could not be started are picked up here */
+	for (i = started + 1; i < threads; i++)
+		fn(&jobs[i]);
+	fn(&jobs[0]);
+
+	for (i = 1; i <= started; i++)
+		pthread_join(tid[i], NULL);
+}
+
+static unsigned int default_threads(unsigned int threads)
+{
+	long ncpu;
+
+	if (!threads) {
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = ncpu > 0 ? ncpu : 1;
+	}
+	if (threads > MAX_THREADS)
+		threads = MAX_THREADS;
+
+	return threads;
+}
+
+double ltc5599_iq_model_dbm(double gain_err_db, double phase_err_deg,
+			    double scale_dbm, double floor_dbm,
+			    int gain_code, int phase_code)
+{
+	double t;
+
+	pthread_once(&tables_once, init_tables);
+
+	if (gain_code < LTC5599_CODE_MIN || gain_code > LTC5599_CODE_MAX ||
+	    phase_code < LTC5599_PHASE_MIN || phase_code > LTC5599_PHASE_MAX)
+		return NAN;
+
+	t = image_term(gain_err_db + gain_corr_db[gain_code - LTC5599_CODE_MIN],
+		       phase_err_deg + phase_corr_deg[phase_code - LTC5599_PHASE_MIN]);
+
+	return lin_to_db(db_to_lin(scale_dbm) * t + db_to_lin(floor_dbm));
+}
+
+unsigned int ltc5599_iq_probe_set(struct ltc5599_iq_meas *m, unsigned int max)
+{
+	static const int probes[][2] = {
+		{ 0, 0 }, { -96, 0 }, { 96, 0 }, { 0, -192 }, { 0, 192 },
+		{ -96, -192 }, { 96, 192 },
+	};
+	unsigned int i;
+
+	for (i = 0; i < max && i < sizeof(probes) / sizeof(probes[0]); i++) {
+		m[i].gain_code = probes[i][0];
+		m[i].phase_code = probes[i][1];
+		m[i].power_dbm = 0;
+	}
+
+	return i;
+}
+
+int ltc5599_iq_solve(const struct ltc5599_iq_meas *m, unsigned int n,
+		     unsigned int threads, struct ltc5599_iq_fit *fit)
+{
+	struct job jobs[MAX_THREADS];
+	struct problem pb;
+	struct result best;
+	struct grid gr;
+	double buf[4 * n], t[n];
+	unsigned int i, level;
+
+	if (n < 3)
+		return -EINVAL;
+
+	pthread_once(&tables_once, init_tables);
+	threads = default_threads(threads);
+
+	pb.n = n;
+	pb.fit_floor = n >= 4;
+	pb.gcorr = buf;
+	pb.pcorr = buf + n;
+	pb.p = buf + 2 * n;
+	pb.w = buf + 3 * n;
+	for (i = 0; i < n; i++) {
+		if (m[i].gain_code < LTC5599_CODE_MIN || m[i].gain_code > LTC5599_CODE_MAX ||
+		    m[i].phase_code < LTC5599_PHASE_MIN || m[i].phase_code > LTC5599_PHASE_MAX)
+			return -EINVAL;
+		pb.gcorr[i] = gain_corr_db[m[i].gain_code - LTC5599_CODE_MIN];
+		pb.pcorr[i] = phase_corr_deg[m[i].phase_code - LTC5599_PHASE_MIN] * (M_PI / 180.0);
+		pb.p[i] = db_to_lin(m[i].power_dbm);
+		pb.w[i] = 1.0 / (pb.p[i] * pb.p[i]);
+	}
+
+	gr.de = 2 * GAIN_RANGE_DB / (GRID_POINTS - 1);
+	gr.dp = 2 * PHASE_RANGE_DEG / (GRID_POINTS - 1);
+	gr.e0 = -GAIN_RANGE_DB;
+	gr.p0 = -PHASE_RANGE_DEG;
+
+	for (level = 0; level < GRID_LEVELS; level++) {
+		memset(jobs, 0, sizeof(jobs));
+		for (i = 0; i < threads; i++) {
+			jobs[i].pb = &pb;
+			jobs[i].grid = &gr;
+		}
+		run_jobs(jobs, threads, grid_worker);
+
+		best = jobs[0].best;
+		for (i = 1; i < threads; i++)
+			if (jobs[i].best.cost < best.cost)
+				best = jobs[i].best;
+		if (best.cost == DBL_MAX)
+			return -EINVAL;
+
+		/* zoom in: the new grid spans GRID_ZOOM old steps around the best */
+		gr.e0 = best.e - GRID_ZOOM / 2.0 * gr.de;
+		gr.p0 = best.p - GRID_ZOOM / 2.0 * gr.dp;
+		gr.de *= (double)GRID_ZOOM / (GRID_POINTS - 1);
+		gr.dp *= (double)GRID_ZOOM / (GRID_POINTS - 1);
+	}
+
+	fit->gain_err_db = best.e;
+	fit->phase_err_deg = best.p;
+	fit->scale_dbm = lin_to_db(best.a);
+	fit->floor_dbm = lin_to_db(best.floor);
+	fit_point(&pb, best.e, best.p, t, &best.a, &best.floor);
+	fit->rms_db = 0;
+	for (i = 0; i < n; i++) {
+		double r = lin_to_db(best.a * t[i] + best.floor) - m[i].power_dbm;
+
+		fit->rms_db += r * r;
+	}
+	fit->rms_db = sqrt(fit->rms_db / n);
+
+	memset(jobs, 0, sizeof(jobs));
+	for (i = 0; i < threads; i++)
+		jobs[i].fit = fit;
+	run_jobs(jobs, threads, code_worker);
+
+	fit->gain_code = jobs[0].gain_code;
+	fit->phase_code = jobs[0].phase_code;
+	for (i = 1; i < threads; i++) {
+		if (jobs[i].best_image < jobs[0].best_image) {
+			jobs[0].best_image = jobs[i].best_image;
+			fit->gain_code = jobs[i].gain_code;
+			fit->phase_code = jobs[i].phase_code;
+		}
+	}
+
+	fit->image_dbm = ltc5599_iq_model_dbm(fit->gain_err_db, fit->phase_err_deg,
+					      fit->scale_dbm, fit->floor_dbm,
+					      fit->gain_code, fit->phase_code);
+	fit->rejection_db = ltc5599_iq_model_dbm(fit->gain_err_db, fit->phase_err_deg,
+						 fit->scale_dbm, fit->floor_dbm, 0, 0) -
+			    fit->image_dbm;
+
+	return 0;
+}
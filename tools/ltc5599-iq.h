@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Model-based IQ imbalance solver for the LTC5599.
+ *
+ * The image sideband of a quadrature modulator with a residual gain
+ * imbalance e (dB) and phase error p (degrees) has the power
+ *
+ *	P = A * (1 + g^2 - 2 g cos p) + N,	g = 10^(e / 20)
+ *
+ * relative to the scale A, on top of a noise floor N. The correction
+ * codes shift e and p by the physical steps the driver's register
+ * encodings produce. From a handful of image power measurements at known
+ * codes the solver fits the uncorrected imbalance, then evaluates every
+ * code pair against the fitted model to predict the optimum.
+ *
+ * Copyright 2025 Henning Paul
+ *  Author: Henning Paul <hnch@gmx.net>
+ */
+
+#ifndef _LTC5599_IQ_H
+#define _LTC5599_IQ_H
+
+/**
+ * struct ltc5599_iq_meas - one image power measurement
+ * @gain_code:	quadrature correction code, -127..127
+ * @phase_code:	phase balance code, -240..239
+ * @power_dbm:	measured image sideband power
+ */
+struct ltc5599_iq_meas {
+	int	gain_code;
+	int	phase_code;
+	double	power_dbm;
+};
+
+/**
+ * struct ltc5599_iq_fit - solver result
+ * @gain_err_db:	fitted gain imbalance at code 0
+ * @phase_err_deg:	fitted phase error at code 0
+ * @scale_dbm:		fitted scale A
+ * @floor_dbm:		fitted noise floor N, -inf without one
+ * @rms_db:		RMS fit residual
+ * @gain_code:		predicted optimal quadrature correction code
+ * @phase_code:		predicted optimal phase balance code
+ * @image_dbm:		predicted image power at the optimum
+ * @rejection_db:	predicted improvement over codes 0/0
+ */
+struct ltc5599_iq_fit {
+	double	gain_err_db;
+	double	phase_err_deg;
+	double	scale_dbm;
+	double	floor_dbm;
+	double	rms_db;
+	int	gain_code;
+	int	phase_code;
+	double	image_dbm;
+	double	rejection_db;
+};
+
+/*
+ * Fit n >= 3 measurements (n >= 4 to fit a noise floor as well) using up
+ * to threads worker threads, 0 for one per CPU. Returns 0 or -EINVAL.
+ */
+int ltc5599_iq_solve(const struct ltc5599_iq_meas *m, unsigned int n,
+		     unsigned int threads, struct ltc5599_iq_fit *fit);
+
+/* code pairs worth measuring for a fit, returns the number written */
+unsigned int ltc5599_iq_probe_set(struct ltc5599_iq_meas *m, unsigned int max);
+
+/* image power the model predicts for the given imbalance and codes */
+double ltc5599_iq_model_dbm(double gain_err_db, double phase_err_deg,
+			    double scale_dbm, double floor_dbm,
+			    int gain_code, int phase_code);
+
+#endif /* _LTC5599_IQ_H */
@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Predict the optimal LTC5599 IQ correction codes from a few image
+ * sideband power measurements instead of sweeping all code pairs.
+ *
+ * Input lines are "[band] <gain code> <phase code> <image power dBm>",
+ * '#' starts a comment. Lines with a band column are fitted per band.
+ *
+ * Copyright 2025 Henning Paul
+ *  Author: Henning Paul <hnch@gmx.net>
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ltc5599-iq.h"
+#include "ltc5599-model.h"
+
+#define MAX_MEAS	4096
+
+struct band_meas {
+	int			band;
+	unsigned int		n;
+	struct ltc5599_iq_meas	m[64];
+};
+
+static struct band_meas bands[LTC5599_NUM_BANDS + 1];
+static unsigned int num_bands;
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static struct band_meas *get_band(int band)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_bands; i++)
+		if (bands[i].band == band)
+			return &bands[i];
+	if (num_bands == LTC5599_NUM_BANDS + 1)
+		return NULL;
+
+	bands[num_bands].band = band;
+	return &bands[num_bands++];
+}
+
+static int read_input(FILE *f)
+{
+	char line[256], *c;
+	struct band_meas *b;
+	double v[4];
+	int n, lineno = 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		c = strchr(line, '#');
+		if (c)
+			*c = 0;
+		n = sscanf(line, "%lf %lf %lf %lf", &v[0], &v[1], &v[2], &v[3]);
+		if (n <= 0)
+			continue;
+		if (n < 3) {
+			fprintf(stderr, "line %d: expected [band] gain phase power\n", lineno);
+			return -EINVAL;
+		}
+
+		b = get_band(n == 4 ? (int)v[0] : 0);
+		if (!b || b->n == sizeof(b->m) / sizeof(b->m[0])) {
+			fprintf(stderr, "line %d: too many measurements\n", lineno);
+			return -EINVAL;
+		}
+		b->m[b->n].gain_code = (int)v[n - 3];
+		b->m[b->n].phase_code = (int)v[n - 2];
+		b->m[b->n].power_dbm = v[n - 1];
+		b->n++;
+	}
+
+	return 0;
+}
+
+/* measurements of a modulator with known imbalance, for a self test */
+static void synthesize(const char *spec)
+{
+	double e = 0, p = 0, floor_dbm = -90;
+	struct band_meas *b = get_band(0);
+	unsigned int i;
+
+	sscanf(spec, "%lf,%lf,%lf", &e, &p, &floor_dbm);
+	b->n = ltc5599_iq_probe_set(b->m, sizeof(b->m) / sizeof(b->m[0]));
+	for (i = 0; i < b->n; i++)
+		b->m[i].power_dbm = ltc5599_iq_model_dbm(e, p, 0, floor_dbm,
+							 b->m[i].gain_code,
+							 b->m[i].phase_code);
+}
+
+static int write_attr(const char *dir, const char *name, int val)
+{
+	char path[512];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	f = fopen(path, "w");
+	if (!f)
+		return -errno;
+	fprintf(f, "%d", val);
+	if (fclose(f))
+		return -errno;
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options] [file]\n"
+		"  -t N      worker threads, 0 for one per CPU (0)\n"
+		"  -p        print the code pairs to measure and exit\n"
+		"  -S E,P[,F] self test with gain error E dB, phase error P deg\n"
+		"            and noise floor F dBm\n"
+		"  -d DIR    write the predicted codes to the IIO device in DIR\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct ltc5599_iq_meas probes[16];
+	struct ltc5599_iq_fit fit;
+	const char *devdir = NULL;
+	unsigned int threads = 0, i, n;
+	double t0, t1;
+	FILE *f = stdin;
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "t:pS:d:h")) != -1) {
+		switch (opt) {
+		case 't':
+			threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			n = ltc5599_iq_probe_set(probes, 16);
+			for (i = 0; i < n; i++)
+				printf("%d %d\n", probes[i].gain_code, probes[i].phase_code);
+			return 0;
+		case 'S':
+			synthesize(optarg);
+			break;
+		case 'd':
+			devdir = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (!num_bands) {
+		if (optind < argc) {
+			f = fopen(argv[optind], "r");
+			if (!f) {
+				perror(argv[optind]);
+				return 1;
+			}
+		}
+		if (read_input(f))
+			return 1;
+	}
+
+	if (devdir && num_bands != 1) {
+		fprintf(stderr, "-d needs measurements of exactly one band\n");
+		return 1;
+	}
+
+	printf("# band gain_code phase_code image_dbm rejection_db gain_err_db phase_err_deg rms_db\n");
+
+	t0 = now_ms();
+	for (i = 0; i < num_bands; i++) {
+		ret = ltc5599_iq_solve(bands[i].m, bands[i].n, threads, &fit);
+		if (ret) {
+			fprintf(stderr, "band %d: cannot fit %u measurements\n",
+				bands[i].band, bands[i].n);
+			continue;
+		}
+		printf("%d %d %d %.2f %.2f %.4f %.4f %.3f\n", bands[i].band,
+		       fit.gain_code, fit.phase_code, fit.image_dbm, fit.rejection_db,
+		       fit.gain_err_db, fit.phase_err_deg, fit.rms_db);
+	}
+	t1 = now_ms();
+	fprintf(stderr, "%u band(s) solved in %.1f ms\n", num_bands, t1 - t0);
+
+	if (devdir && !ret) {
+		ret = write_attr(devdir, "out_altvoltage_quadrature_correction_raw",
+				 fit.gain_code);
+		if (!ret)
+			ret = write_attr(devdir, "out_altvoltage_phase", fit.phase_code);
+		if (ret)
+			fprintf(stderr, "%s: %s\n", devdir, strerror(-ret));
+	}
+
+	return ret ? 1 : 0;
+}
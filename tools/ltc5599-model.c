@@ -0,0 +1,269 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Userspace model of the LTC5599 register mapping.
+ *
+ * Copyright 2025 Henning Paul
+ *  Author: Henning Paul <hnch@gmx.net>
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "ltc5599-model.h"
+
+#define LTC5599_FREQ_MASK		0x7F
+#define LTC5599_IQ_PHASEBAL_EXT_SIGN_BIT (1 << 7)
+#define LTC5599_GAIN_MASK		0x1F
+#define LTC5599_QDISABLE_BIT		(1 << 5)
+#define LTC5599_AGCTRL_BIT		(1 << 6)
+#define LTC5599_IQ_PHASEBAL_FINE_MASK	0x1F
+#define LTC5599_IQ_PHASEBAL_EXT_SHIFT	5
+#define LTC5599_IQ_PHASEBAL_EXT_MASK	(0x07 << LTC5599_IQ_PHASEBAL_EXT_SHIFT)
+
+/* lower band edges in kHz, highest band first, as in ltc5599.c */
+static const unsigned int band_edges_khz[LTC5599_NUM_BANDS - 1] = {
+	1249100, 1248600, 1238100, 1214100, 1191200, 1165600, 1141000, 1120600,
+	1100500, 1069500, 1039599, 1023100, 1007100, 988300, 961800, 941300,
+	921500, 895200, 877600, 863600, 843200, 826900, 807000, 792300,
+	772200, 752700, 734000, 724200, 704600, 688700, 673200, 655200,
+	638100, 624600, 611900, 598400, 585100, 573900, 563100, 548100,
+	538100, 529100, 518500, 507000, 497700, 488000, 471500, 457700,
+	448700, 437400, 426600, 417500, 407500, 398000, 390100, 382800,
+	376600, 369800, 353100, 339000, 332600, 327200, 320600, 313700,
+	309100, 304500, 288100, 278300, 274200, 270300, 266000, 261899,
+	258200, 254100, 243600, 233800, 230800, 228000, 220200, 212600,
+	210000, 207600, 202100, 196200, 193700, 191200, 186600, 182000,
+	179400, 176000, 170100, 165000, 162500, 160000, 156700, 153600,
+	151100, 148600, 142500, 139600, 136500, 134300, 131200, 128100,
+	126000, 123800, 121300, 118300, 115700, 113500, 111300, 109500,
+	107600, 105600, 103000, 100300, 98500, 96600, 94700, 93000,
+};
+
+static const int phase_coarse_udeg[8] = {
+	0, 333333, 666667, 1000000, 1333333, 1666667, 2000000, 2333333,
+};
+
+static const int phase_fine_udeg[32] = {
+	-166667, -156250, -145833, -135417, -125000, -114583, -104167, -93750,
+	-83333, -72917, -62500, -52083, -41667, -31250, -20833, -10417,
+	0, 10417, 20833, 31250, 41667, 52083, 62500, 72917,
+	83333, 93750, 104167, 114583, 125000, 135417, 145833, 156250,
+};
+
+static const int gainrat_hi_udb[16] = {
+	-500000, -437500, -375000, -312500, -250000, -187500, -125000, -62500,
+	0, 62500, 125000, 187500, 250000, 312500, 375000, 437500,
+};
+
+static const int gainrat_lo_udb[16] = {
+	0, 3906, 7813, 11719, 15625, 19531, 23438, 27344,
+	31250, 35156, 39063, 42969, 46875, 50781, 54688, 58594,
+};
+
+void ltc5599_model_reset(uint8_t *regs)
+{
+	memset(regs, 0, LTC5599_NUM_REGS);
+	regs[LTC5599_FREQ_REG]		= 0x2E;
+	regs[LTC5599_GAIN_REG]		= 0x84;
+	regs[LTC5599_OFFSI_REG]		= 0x80;
+	regs[LTC5599_OFFSQ_REG]		= 0x80;
+	regs[LTC5599_IQ_GAINRAT_REG]	= 0x80;
+	regs[LTC5599_IQ_PHASEBAL_REG]	= 0x10;
+	regs[LTC5599_LOMATCH_OVR_REG]	= 0x50;
+	regs[LTC5599_TEMPCORR_OVR_REG]	= 0x06;
+	regs[LTC5599_MODE_REG]		= 0x00;
+}
+
+unsigned int ltc5599_model_freq_to_band(unsigned int freq_in_khz)
+{
+	unsigned int i;
+
+	for (i = 0; i < LTC5599_NUM_BANDS - 1; i++)
+		if (freq_in_khz > band_edges_khz[i])
+			return i + 1;
+
+	return LTC5599_NUM_BANDS;
+}
+
+unsigned int ltc5599_model_band_edge_khz(unsigned int word)
+{
+	return band_edges_khz[word - 1];
+}
+
+unsigned int ltc5599_model_band_mid_khz(unsigned int word)
+{
+	unsigned int lo = LTC5599_FREQ_MIN / 1000, hi = LTC5599_FREQ_MAX / 1000;
+
+	if (word < LTC5599_NUM_BANDS)
+		lo = band_edges_khz[word - 1];
+	if (word > 1)
+		hi = band_edges_khz[word - 2];
+
+	return lo + (hi - lo) / 2;
+}
+
+int ltc5599_model_band_to_freq(unsigned int word)
+{
+	if (word < 1)
+		word = 1;
+	if (word > LTC5599_NUM_BANDS)
+		word = LTC5599_NUM_BANDS;
+
+	return ltc5599_model_band_mid_khz(word) * 1000;
+}
+
+static void encode_iqphasebalance(uint8_t *regs, int val)
+{
+	int coarse;
+
+	if (val < -16)
+		regs[LTC5599_FREQ_REG] &= ~LTC5599_IQ_PHASEBAL_EXT_SIGN_BIT;
+	else
+		regs[LTC5599_FREQ_REG] |= LTC5599_IQ_PHASEBAL_EXT_SIGN_BIT;
+
+	if (val > 0)
+		coarse = (val + 16) / 32;
+	else
+		coarse = (15 - val) / 32;
+
+	regs[LTC5599_IQ_PHASEBAL_REG] = ((coarse & 0x07) << LTC5599_IQ_PHASEBAL_EXT_SHIFT) |
+		(((val & 0x1F) ^ 0x10) & LTC5599_IQ_PHASEBAL_FINE_MASK);
+}
+
+static int decode_iqphasebalance(const uint8_t *regs)
+{
+	int multiplier, coarse, val;
+
+	multiplier = regs[LTC5599_FREQ_REG] & LTC5599_IQ_PHASEBAL_EXT_SIGN_BIT ? 1 : -1;
+	coarse = (regs[LTC5599_IQ_PHASEBAL_REG] & LTC5599_IQ_PHASEBAL_EXT_MASK) >>
+		LTC5599_IQ_PHASEBAL_EXT_SHIFT;
+
+	val = (regs[LTC5599_IQ_PHASEBAL_REG] & LTC5599_IQ_PHASEBAL_FINE_MASK) - 16;
+	val += multiplier * coarse * 32;
+
+	return val;
+}
+
+int ltc5599_model_phase_udeg(int code)
+{
+	uint8_t regs[LTC5599_NUM_REGS] = { 0 };
+	unsigned int coarse, fine;
+	int val;
+
+	encode_iqphasebalance(regs, code);
+	coarse = (regs[LTC5599_IQ_PHASEBAL_REG] & LTC5599_IQ_PHASEBAL_EXT_MASK) >>
+		LTC5599_IQ_PHASEBAL_EXT_SHIFT;
+	fine = regs[LTC5599_IQ_PHASEBAL_REG] & LTC5599_IQ_PHASEBAL_FINE_MASK;
+
+	val = phase_coarse_udeg[coarse];
+	if (!(regs[LTC5599_FREQ_REG] & LTC5599_IQ_PHASEBAL_EXT_SIGN_BIT))
+		val = -val;
+
+	return val + phase_fine_udeg[fine];
+}
+
+int ltc5599_model_gainrat_udb(int code)
+{
+	uint8_t tmp = (uint8_t)code ^ 0x80;
+
+	return gainrat_hi_udb[tmp >> 4] + gainrat_lo_udb[tmp & 0x0F];
+}
+
+int ltc5599_model_apply(uint8_t *regs, enum ltc5599_param param,
+			unsigned int index, int val)
+{
+	uint8_t bit;
+
+	switch (param) {
+	case LTC5599_PARAM_OFFSET:
+		if (index > 1 || val < LTC5599_CODE_MIN || val > LTC5599_CODE_MAX)
+			return -EINVAL;
+		regs[LTC5599_OFFSI_REG + index] = val + 128;
+		break;
+	case LTC5599_PARAM_FREQUENCY:
+		if (val < LTC5599_FREQ_MIN || val > LTC5599_FREQ_MAX)
+			return -EINVAL;
+		regs[LTC5599_FREQ_REG] = (regs[LTC5599_FREQ_REG] & ~LTC5599_FREQ_MASK) |
+			(ltc5599_model_freq_to_band(val / 1000) & LTC5599_FREQ_MASK);
+		break;
+	case LTC5599_PARAM_HARDWAREGAIN:
+		if (val > 0)
+			return -EINVAL;
+		val = -val;
+		if (val > -LTC5599_GAIN_MIN)
+			val = -LTC5599_GAIN_MIN;
+		regs[LTC5599_GAIN_REG] = (regs[LTC5599_GAIN_REG] & ~LTC5599_GAIN_MASK) |
+			(val & LTC5599_GAIN_MASK);
+		break;
+	case LTC5599_PARAM_QUADRATURE_CORRECTION:
+		if (val < LTC5599_CODE_MIN || val > LTC5599_CODE_MAX)
+			return -EINVAL;
+		regs[LTC5599_IQ_GAINRAT_REG] = (val & 0xFF) ^ 0x80;
+		break;
+	case LTC5599_PARAM_PHASE:
+		if (val < LTC5599_PHASE_MIN || val > LTC5599_PHASE_MAX)
+			return -EINVAL;
+		encode_iqphasebalance(regs, val);
+		break;
+	case LTC5599_PARAM_REG:
+		if (index >= LTC5599_NUM_REGS)
+			return -EINVAL;
+		if (index == LTC5599_FREQ_REG &&
+		    (val & LTC5599_FREQ_MASK) > LTC5599_NUM_BANDS)
+			return -EINVAL;
+		regs[index] = val;
+		break;
+	case LTC5599_PARAM_QDISABLE:
+	case LTC5599_PARAM_AGCTRL:
+		if (val < 0 || val > 1)
+			return -EINVAL;
+		bit = param == LTC5599_PARAM_QDISABLE ? LTC5599_QDISABLE_BIT :
+			LTC5599_AGCTRL_BIT;
+		regs[LTC5599_GAIN_REG] = val ? regs[LTC5599_GAIN_REG] | bit :
+			regs[LTC5599_GAIN_REG] & ~bit;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int ltc5599_model_read(const uint8_t *regs, enum ltc5599_param param,
+		       unsigned int index, int *val)
+{
+	switch (param) {
+	case LTC5599_PARAM_OFFSET:
+		if (index > 1)
+			return -EINVAL;
+		*val = regs[LTC5599_OFFSI_REG + index] - 128;
+		break;
+	case LTC5599_PARAM_FREQUENCY:
+		*val = ltc5599_model_band_to_freq(regs[LTC5599_FREQ_REG] & LTC5599_FREQ_MASK);
+		break;
+	case LTC5599_PARAM_HARDWAREGAIN:
+		*val = -(int)(regs[LTC5599_GAIN_REG] & LTC5599_GAIN_MASK);
+		break;
+	case LTC5599_PARAM_QUADRATURE_CORRECTION:
+		*val = regs[LTC5599_IQ_GAINRAT_REG] - 128;
+		break;
+	case LTC5599_PARAM_PHASE:
+		*val = decode_iqphasebalance(regs);
+		break;
+	case LTC5599_PARAM_REG:
+		if (index >= LTC5599_NUM_REGS)
+			return -EINVAL;
+		*val = regs[index];
+		break;
+	case LTC5599_PARAM_QDISABLE:
+		*val = !!(regs[LTC5599_GAIN_REG] & LTC5599_QDISABLE_BIT);
+		break;
+	case LTC5599_PARAM_AGCTRL:
+		*val = !!(regs[LTC5599_GAIN_REG] & LTC5599_AGCTRL_BIT);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Userspace model of the LTC5599 register mapping.
+ *
+ * Mirrors the encoders, range checks and clamping of ltc5599.c so that
+ * tools can predict the register image and the values read back through
+ * sysfs without a device. Keep it in sync with the driver.
+ *
+ * Copyright 2025 Henning Paul
+ *  Author: Henning Paul <hnch@gmx.net>
+ */
+
+#ifndef _LTC5599_MODEL_H
+#define _LTC5599_MODEL_H
+
+#include <stdint.h>
+
+#include "uapi/ltc5599.h"
+
+#define LTC5599_NUM_REGS	9
+#define LTC5599_NUM_BANDS	121
+
+#define LTC5599_FREQ_REG	0x00
+#define LTC5599_GAIN_REG	0x01
+#define LTC5599_OFFSI_REG	0x02
+#define LTC5599_OFFSQ_REG	0x03
+#define LTC5599_IQ_GAINRAT_REG	0x04
+#define LTC5599_IQ_PHASEBAL_REG	0x05
+#define LTC5599_LOMATCH_OVR_REG	0x06
+#define LTC5599_TEMPCORR_OVR_REG 0x07
+#define LTC5599_MODE_REG	0x08
+
+#define LTC5599_CODE_MIN	-127
+#define LTC5599_CODE_MAX	127
+#define LTC5599_PHASE_MIN	-240
+#define LTC5599_PHASE_MAX	239
+#define LTC5599_GAIN_MIN	-19
+#define LTC5599_FREQ_MIN	30000000
+#define LTC5599_FREQ_MAX	1300000000
+
+/* register image after reset, as written by the driver at probe */
+void ltc5599_model_reset(uint8_t *regs);
+
+unsigned int ltc5599_model_freq_to_band(unsigned int freq_in_khz);
+int ltc5599_model_band_to_freq(unsigned int band);
+/* frequency in kHz that selects band, as listed in frequency_available */
+unsigned int ltc5599_model_band_mid_khz(unsigned int band);
+/* lower edge in kHz of band 1..LTC5599_NUM_BANDS - 1 */
+unsigned int ltc5599_model_band_edge_khz(unsigned int band);
+
+/* IQ correction codes to physical units, see ltc5599.c */
+int ltc5599_model_phase_udeg(int code);
+int ltc5599_model_gainrat_udb(int code);
+
+/*
+ * Apply one parameter update like write_raw, 0 or -EINVAL. Returns the
+ * register image in regs, which is untouched on error.
+ */
+int ltc5599_model_apply(uint8_t *regs, enum ltc5599_param param,
+			unsigned int index, int value);
+
+/* read back one parameter like read_raw, 0 or -EINVAL */
+int ltc5599_model_read(const uint8_t *regs, enum ltc5599_param param,
+		       unsigned int index, int *value);
+
+#endif /* _LTC5599_MODEL_H */
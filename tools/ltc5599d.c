@@ -0,0 +1,749 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * LTC5599 control daemon.
+ *
+ * Owns one LTC5599 and multiplexes any number of clients on a Unix stream
+ * socket. Updates arriving within one scheduling quantum are merged, the
+ * last value per parameter wins, and committed together: one
+ * LTC5599_IOC_APPLY (one SPI burst) with the character device backend.
+ * Reads are served from the daemon's cache of the register image and
+ * never touch the device. Watchers get a line per changed parameter.
+ *
+ * Protocol, one command per line:
+ *   set <param> [index] <value>	ok <generation> once committed
+ *   get <param> [index]		ok <value>
+ *   regs				ok <register image in hex>
+ *   watch				ok, then "event <generation> <param> <index> <value>"
+ *   stats				ok commits=.. updates=.. requests=..
+ * with <param> one of offset (index 0/1), frequency, hardwaregain,
+ * quadrature_correction, phase, q_disable, agc_control or reg
+ * (index = address). Errors are
+ * answered with "err <reason>".
+ *
+ * Backends: the character device (-c), the sysfs attributes (-d) or a
+ * software stand-in built on the register model (-S).
+ *
+ * Copyright 2025 Henning Paul
+ *  Author: Henning Paul <hnch@gmx.net>
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+
+#include "ltc5599-model.h"
+
+#define DEFAULT_SOCKET		"/run/ltc5599.sock"
+#define MAX_CLIENTS		1024
+#define MAX_WAITERS		4096
+#define LINE_MAX_LEN		256
+
+enum backend {
+	BACKEND_SIM,
+	BACKEND_SYSFS,
+	BACKEND_CHARDEV,
+};
+
+/* one merge slot per parameter instance, in commit order */
+enum slot {
+	SLOT_FREQUENCY,
+	SLOT_HARDWAREGAIN,
+	SLOT_OFFSET_I,
+	SLOT_OFFSET_Q,
+	SLOT_QUADRATURE_CORRECTION,
+	SLOT_PHASE,
+	SLOT_QDISABLE,
+	SLOT_AGCTRL,
+	SLOT_REG0,
+	NUM_SLOTS = SLOT_REG0 + LTC5599_NUM_REGS,
+};
+
+struct param_desc {
+	const char		*name;
+	enum ltc5599_param	param;
+	bool			indexed;
+	const char		*attr;
+};
+
+static const struct param_desc params[] = {
+	{ "offset",		   LTC5599_PARAM_OFFSET,		true,  "out_altvoltage%u_offset" },
+	{ "frequency",		   LTC5599_PARAM_FREQUENCY,		false, "out_altvoltage_frequency" },
+	{ "hardwaregain",	   LTC5599_PARAM_HARDWAREGAIN,		false, "out_altvoltage_hardwaregain" },
+	{ "quadrature_correction", LTC5599_PARAM_QUADRATURE_CORRECTION,	false, "out_altvoltage_quadrature_correction_raw" },
+	{ "phase",		   LTC5599_PARAM_PHASE,			false, "out_altvoltage_phase" },
+	{ "q_disable",		   LTC5599_PARAM_QDISABLE,		false, "q_disable" },
+	{ "agc_control",	   LTC5599_PARAM_AGCTRL,		false, "agc_control" },
+	{ "reg",		   LTC5599_PARAM_REG,			true,  NULL },
+};
+
+#define NUM_PARAMS (sizeof(params) / sizeof(params[0]))
+
+struct client {
+	int		fd;
+	unsigned int	id;
+	bool		watch;
+	size_t		inlen;
+	char		in[LINE_MAX_LEN];
+};
+
+struct waiter {
+	int		fd;
+	unsigned int	id;
+};
+
+static enum backend backend = BACKEND_SIM;
+static const char *devpath;
+static int devfd = -1;
+static unsigned int quantum_us = 1000;
+static unsigned int sim_latency_us;
+static bool verbose;
+
+static uint8_t cache[LTC5599_NUM_REGS];
+static unsigned int generation;
+
+static bool pending[NUM_SLOTS];
+static int pending_value[NUM_SLOTS];
+static struct waiter waiters[MAX_WAITERS];
+static unsigned int num_waiters;
+
+static struct client *clients[MAX_CLIENTS];
+static unsigned int next_id;
+static int epfd, timerfd;
+static volatile sig_atomic_t quit;
+
+static unsigned long stat_commits, stat_updates, stat_requests;
+
+static enum ltc5599_param slot_param(enum slot s, unsigned int *index)
+{
+	*index = 0;
+	switch (s) {
+	case SLOT_FREQUENCY:
+		return LTC5599_PARAM_FREQUENCY;
+	case SLOT_HARDWAREGAIN:
+		return LTC5599_PARAM_HARDWAREGAIN;
+	case SLOT_OFFSET_I:
+	case SLOT_OFFSET_Q:
+		*index = s - SLOT_OFFSET_I;
+		return LTC5599_PARAM_OFFSET;
+	case SLOT_QUADRATURE_CORRECTION:
+		return LTC5599_PARAM_QUADRATURE_CORRECTION;
+	case SLOT_PHASE:
+		return LTC5599_PARAM_PHASE;
+	case SLOT_QDISABLE:
+		return LTC5599_PARAM_QDISABLE;
+	case SLOT_AGCTRL:
+		return LTC5599_PARAM_AGCTRL;
+	default:
+		*index = s - SLOT_REG0;
+		return LTC5599_PARAM_REG;
+	}
+}
+
+static int param_slot(enum ltc5599_param param, unsigned int index)
+{
+	switch (param) {
+	case LTC5599_PARAM_OFFSET:
+		return index > 1 ? -1 : (int)(SLOT_OFFSET_I + index);
+	case LTC5599_PARAM_FREQUENCY:
+		return SLOT_FREQUENCY;
+	case LTC5599_PARAM_HARDWAREGAIN:
+		return SLOT_HARDWAREGAIN;
+	case LTC5599_PARAM_QUADRATURE_CORRECTION:
+		return SLOT_QUADRATURE_CORRECTION;
+	case LTC5599_PARAM_PHASE:
+		return SLOT_PHASE;
+	case LTC5599_PARAM_QDISABLE:
+		return SLOT_QDISABLE;
+	case LTC5599_PARAM_AGCTRL:
+		return SLOT_AGCTRL;
+	case LTC5599_PARAM_REG:
+		return index >= LTC5599_NUM_REGS ? -1 : (int)(SLOT_REG0 + index);
+	}
+
+	return -1;
+}
+
+static const struct param_desc *find_param(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_PARAMS; i++)
+		if (!strcmp(params[i].name, name))
+			return &params[i];
+
+	return NULL;
+}
+
+static const struct param_desc *param_desc(enum ltc5599_param param)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_PARAMS; i++)
+		if (params[i].param == param)
+			return &params[i];
+
+	return NULL;
+}
+
+static void client_close(struct client *c)
+{
+	epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	clients[c->fd] = NULL;
+	free(c);
+}
+
+/* replies are short; a client that cannot take one is dropped */
+static void client_send(struct client *c, const char *fmt, ...)
+{
+	char buf[LINE_MAX_LEN];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	if (send(c->fd, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT) != len)
+		client_close(c);
+}
+
+static struct client *waiter_client(const struct waiter *w)
+{
+	struct client *c = clients[w->fd];
+
+	return c && c->id == w->id ? c : NULL;
+}
+
+/* sysfs backend */
+
+static int sysfs_write(const struct param_desc *p, unsigned int index, int value)
+{
+	char path[512], name[64], buf[32];
+	int fd, len, ret = 0;
+
+	if (!p->attr)
+		return -EOPNOTSUPP;
+
+	snprintf(name, sizeof(name), p->attr, index);
+	snprintf(path, sizeof(path), "%s/%s", devpath, name);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+
+	len = snprintf(buf, sizeof(buf), "%d", value);
+	if (write(fd, buf, len) != len)
+		ret = -errno;
+	close(fd);
+
+	return ret;
+}
+
+static int sysfs_read(const struct param_desc *p, unsigned int index, int *value)
+{
+	char path[512], name[64], buf[32];
+	ssize_t len;
+	int fd;
+
+	snprintf(name, sizeof(name), p->attr, index);
+	snprintf(path, sizeof(path), "%s/%s", devpath, name);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return -EIO;
+	buf[len] = 0;
+	*value = strtol(buf, NULL, 10);
+
+	return 0;
+}
+
+/*
+ * Band centre older drivers report through out_altvoltage_frequency; it
+ * does not always quantise back to its own band.
+ */
+static int legacy_band_centre(unsigned int word)
+{
+	long long tmp;
+
+	tmp = -553LL * (int)word * (int)word * (int)word;
+	tmp += 198810LL * (int)word * (int)word;
+	tmp += -26120002LL * (int)word;
+	tmp += 1319492809LL;
+
+	return (int)tmp;
+}
+
+/*
+ * Map a frequency read back from the driver to the frequency of its band
+ * in the model by matching it against the values drivers report, instead
+ * of quantising it again.
+ */
+static int band_freq(int freq)
+{
+	unsigned int word;
+
+	for (word = 1; word <= LTC5599_NUM_BANDS; word++)
+		if (freq == ltc5599_model_band_to_freq(word) ||
+		    freq == legacy_band_centre(word))
+			return ltc5599_model_band_to_freq(word);
+
+	return freq;
+}
+
+static int load_state(void)
+{
+	struct ltc5599_state state;
+	unsigned int i, index;
+	int value, ret;
+
+	ltc5599_model_reset(cache);
+
+	switch (backend) {
+	case BACKEND_CHARDEV:
+		if (ioctl(devfd, LTC5599_IOC_GET_STATE, &state))
+			return -errno;
+		memcpy(cache, state.regs, LTC5599_NUM_REGS);
+		generation = state.generation;
+		return 0;
+	case BACKEND_SYSFS:
+		for (i = 0; i < NUM_SLOTS; i++) {
+			enum ltc5599_param param = slot_param(i, &index);
+			const struct param_desc *p = param_desc(param);
+
+			if (!p->attr)
+				continue;
+			ret = sysfs_read(p, index, &value);
+			if (ret)
+				return ret;
+			if (param == LTC5599_PARAM_FREQUENCY)
+				value = band_freq(value);
+			ltc5599_model_apply(cache, param, index, value);
+		}
+		return 0;
+	default:
+		return 0;
+	}
+}
+
+/* write the merged updates, last value per slot, in slot order */
+static int commit(void)
+{
+	struct ltc5599_op ops[NUM_SLOTS];
+	struct ltc5599_batch batch;
+	struct ltc5599_state state;
+	uint8_t regs[LTC5599_NUM_REGS];
+	unsigned int i, n = 0, index;
+	int ret = 0;
+
+	for (i = 0; i < NUM_SLOTS; i++) {
+		if (!pending[i])
+			continue;
+		ops[n].param = slot_param(i, &index);
+		ops[n].index = index;
+		ops[n].value = pending_value[i];
+		n++;
+	}
+	if (!n)
+		return 0;
+
+	memcpy(regs, cache, sizeof(regs));
+	for (i = 0; i < n; i++)
+		ltc5599_model_apply(regs, ops[i].param, ops[i].index, ops[i].value);
+
+	switch (backend) {
+	case BACKEND_CHARDEV:
+		batch.count = n;
+		batch.flags = 0;
+		batch.ops = (uintptr_t)ops;
+		if (ioctl(devfd, LTC5599_IOC_APPLY, &batch)) {
+			ret = -errno;
+			break;
+		}
+		if (!ioctl(devfd, LTC5599_IOC_GET_STATE, &state)) {
+			memcpy(regs, state.regs, LTC5599_NUM_REGS);
+			generation = state.generation - 1;
+		}
+		break;
+	case BACKEND_SYSFS:
+		for (i = 0; i < n && !ret; i++)
+			ret = sysfs_write(param_desc(ops[i].param), ops[i].index,
+					  ops[i].value);
+		break;
+	default:
+		if (sim_latency_us)
+			usleep(sim_latency_us);
+		break;
+	}
+
+	if (!ret) {
+		memcpy(cache, regs, sizeof(cache));
+		generation++;
+	} else if (backend == BACKEND_SYSFS) {
+		/* some attributes may have been written */
+		load_state();
+	}
+
+	stat_commits++;
+	stat_updates += n;
+	if (verbose)
+		fprintf(stderr, "commit %u updates: %s\n", n, ret ? strerror(-ret) : "ok");
+
+	return ret;
+}
+
+static void publish(const uint8_t *old)
+{
+	unsigned int i, c, index;
+	int a, b;
+
+	for (i = 0; i < SLOT_REG0; i++) {
+		enum ltc5599_param param = slot_param(i, &index);
+
+		ltc5599_model_read(old, param, index, &a);
+		ltc5599_model_read(cache, param, index, &b);
+		if (a == b)
+			continue;
+
+		for (c = 0; c < MAX_CLIENTS; c++)
+			if (clients[c] && clients[c]->watch)
+				client_send(clients[c], "event %u %s %u %d\n", generation,
+					    param_desc(param)->name, index, b);
+	}
+}
+
+static void flush(void)
+{
+	uint8_t old[LTC5599_NUM_REGS];
+	struct itimerspec its = { 0 };
+	struct client *c;
+	unsigned int i;
+	int ret;
+
+	timerfd_settime(timerfd, 0, &its, NULL);
+
+	memcpy(old, cache, sizeof(old));
+	ret = commit();
+
+	for (i = 0; i < num_waiters; i++) {
+		c = waiter_client(&waiters[i]);
+		if (!c)
+			continue;
+		if (ret)
+			client_send(c, "err %s\n", strerror(-ret));
+		else
+			client_send(c, "ok %u\n", generation);
+	}
+	num_waiters = 0;
+	memset(pending, 0, sizeof(pending));
+
+	if (!ret)
+		publish(old);
+}
+
+static void queue_update(struct client *c, int slot, int value)
+{
+	struct itimerspec its = { 0 };
+
+	if (!num_waiters) {
+		its.it_value.tv_sec = quantum_us / 1000000;
+		its.it_value.tv_nsec = (quantum_us % 1000000) * 1000;
+		if (!quantum_us)
+			its.it_value.tv_nsec = 1;
+		timerfd_settime(timerfd, 0, &its, NULL);
+	}
+
+	pending[slot] = true;
+	pending_value[slot] = value;
+	waiters[num_waiters].fd = c->fd;
+	waiters[num_waiters].id = c->id;
+	num_waiters++;
+
+	if (num_waiters == MAX_WAITERS)
+		flush();
+}
+
+static void handle_line(struct client *c, char *line)
+{
+	char *argv[4], *save, *tok;
+	const struct param_desc *p;
+	uint8_t regs[LTC5599_NUM_REGS];
+	unsigned int index = 0, i;
+	int argc = 0, value, slot;
+
+	for (tok = strtok_r(line, " \t\r", &save); tok && argc < 4;
+	     tok = strtok_r(NULL, " \t\r", &save))
+		argv[argc++] = tok;
+	if (!argc)
+		return;
+
+	stat_requests++;
+
+	if (!strcmp(argv[0], "watch")) {
+		c->watch = true;
+		client_send(c, "ok\n");
+		return;
+	}
+
+	if (!strcmp(argv[0], "regs")) {
+		char buf[LINE_MAX_LEN];
+		int len = 0;
+
+		for (i = 0; i < LTC5599_NUM_REGS; i++)
+			len += snprintf(buf + len, sizeof(buf) - len, " %02x", cache[i]);
+		client_send(c, "ok%s\n", buf);
+		return;
+	}
+
+	if (!strcmp(argv[0], "stats")) {
+		client_send(c, "ok commits=%lu updates=%lu requests=%lu\n",
+			    stat_commits, stat_updates, stat_requests);
+		return;
+	}
+
+	if (argc < 2 || !(p = find_param(argv[1]))) {
+		client_send(c, "err unknown command\n");
+		return;
+	}
+	if (p->indexed) {
+		if (argc < 3) {
+			client_send(c, "err missing index\n");
+			return;
+		}
+		index = strtoul(argv[2], NULL, 0);
+	}
+
+	if (!strcmp(argv[0], "get")) {
+		if (ltc5599_model_read(cache, p->param, index, &value))
+			client_send(c, "err invalid argument\n");
+		else
+			client_send(c, "ok %d\n", value);
+		return;
+	}
+
+	if (!strcmp(argv[0], "set")) {
+		if (argc != (p->indexed ? 4 : 3)) {
+			client_send(c, "err missing value\n");
+			return;
+		}
+		value = strtol(argv[argc - 1], NULL, 0);
+
+		/* reject what the driver would reject, before merging */
+		memcpy(regs, cache, sizeof(regs));
+		slot = param_slot(p->param, index);
+		if (slot < 0 || ltc5599_model_apply(regs, p->param, index, value)) {
+			client_send(c, "err invalid argument\n");
+			return;
+		}
+		queue_update(c, slot, value);
+		return;
+	}
+
+	client_send(c, "err unknown command\n");
+}
+
+static void handle_client(struct client *c)
+{
+	ssize_t len;
+	char *nl;
+	int fd = c->fd;
+
+	len = recv(fd, c->in + c->inlen, sizeof(c->in) - c->inlen - 1, 0);
+	if (len <= 0) {
+		if (len == 0 || (errno != EAGAIN && errno != EINTR))
+			client_close(c);
+		return;
+	}
+	c->inlen += len;
+	c->in[c->inlen] = 0;
+
+	/* the client may be closed by a failed reply while handling lines */
+	while (clients[fd] == c && (nl = memchr(c->in, '\n', c->inlen))) {
+		*nl = 0;
+		handle_line(c, c->in);
+		if (clients[fd] != c)
+			return;
+		c->inlen -= nl + 1 - c->in;
+		memmove(c->in, nl + 1, c->inlen);
+		c->in[c->inlen] = 0;
+	}
+
+	if (clients[fd] == c && c->inlen == sizeof(c->in) - 1)
+		client_close(c);
+}
+
+static void accept_client(int lfd)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+	struct client *c;
+	int fd;
+
+	fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd < 0)
+		return;
+	if (fd >= MAX_CLIENTS) {
+		close(fd);
+		return;
+	}
+
+	c = calloc(1, sizeof(*c));
+	if (!c) {
+		close(fd);
+		return;
+	}
+	c->fd = fd;
+	c->id = ++next_id;
+	clients[fd] = c;
+
+	ev.data.fd = fd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void on_signal(int sig)
+{
+	quit = 1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -s PATH   listening socket (" DEFAULT_SOCKET ")\n"
+		"  -c DEV    use the character device, e.g. /dev/ltc5599-spi1.0\n"
+		"  -d DIR    use the IIO sysfs attributes in DIR\n"
+		"  -S        software stand-in, no device (default)\n"
+		"  -l US     stand-in commit latency in microseconds (0)\n"
+		"  -q US     merge quantum in microseconds (%u)\n"
+		"  -v        log every commit\n",
+		prog, quantum_us);
+}
+
+int main(int argc, char **argv)
+{
+	const char *sockpath = DEFAULT_SOCKET;
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct epoll_event ev, events[64];
+	struct sigaction sa = { .sa_handler = on_signal };
+	uint64_t expirations;
+	int lfd, opt, n, i, ret;
+
+	while ((opt = getopt(argc, argv, "s:c:d:Sl:q:vh")) != -1) {
+		switch (opt) {
+		case 's':
+			sockpath = optarg;
+			break;
+		case 'c':
+			backend = BACKEND_CHARDEV;
+			devpath = optarg;
+			break;
+		case 'd':
+			backend = BACKEND_SYSFS;
+			devpath = optarg;
+			break;
+		case 'S':
+			backend = BACKEND_SIM;
+			break;
+		case 'l':
+			sim_latency_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			quantum_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (backend == BACKEND_CHARDEV) {
+		devfd = open(devpath, O_RDWR | O_CLOEXEC);
+		if (devfd < 0) {
+			perror(devpath);
+			return 1;
+		}
+	}
+
+	ret = load_state();
+	if (ret) {
+		fprintf(stderr, "cannot read device state: %s\n", strerror(-ret));
+		return 1;
+	}
+
+	lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (lfd < 0) {
+		perror("socket");
+		return 1;
+	}
+	strncpy(addr.sun_path, sockpath, sizeof(addr.sun_path) - 1);
+	unlink(sockpath);
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) || listen(lfd, 64)) {
+		perror(sockpath);
+		return 1;
+	}
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (epfd < 0 || timerfd < 0) {
+		perror("epoll");
+		return 1;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.fd = lfd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev);
+	ev.data.fd = timerfd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, timerfd, &ev);
+
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	while (!quit) {
+		n = epoll_wait(epfd, events, 64, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait");
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			int fd = events[i].data.fd;
+
+			if (fd == lfd) {
+				accept_client(lfd);
+			} else if (fd == timerfd) {
+				if (read(timerfd, &expirations, sizeof(expirations)) > 0)
+					flush();
+			} else if (fd < MAX_CLIENTS && clients[fd]) {
+				handle_client(clients[fd]);
+			}
+		}
+	}
+
+	if (num_waiters)
+		flush();
+	unlink(sockpath);
+
+	return 0;
+}